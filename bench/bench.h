@@ -0,0 +1,88 @@
+#pragma once
+
+/* Minimal timing harness shared by the bench/ programs.
+ * Each benchmark collects one sample (ns) per iteration and reports the
+ * median and p99 so a single slow run does not skew the result.
+ * When $BENCH_JSON names a file every result is also appended to it as a
+ * JSON line, so runs can be compared across releases.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifndef BENCH_NAME
+#define BENCH_NAME "bench"   // set per program by the Makefile
+#endif
+
+static inline double bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int bench_cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void bench_json_string(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fputc('\\', f);
+        if ((unsigned char)*s >= 0x20)
+            fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+// One line of $BENCH_JSON: {"bench", "name", "rev", "iterations", ...}
+static void bench_json(const char *name, size_t n, double median, double p99, double mbps)
+{
+    const char *path = getenv("BENCH_JSON");
+    if (path == NULL || *path == '\0')
+        return;
+    FILE *f = fopen(path, "a");
+    if (f == NULL)
+        return;
+
+    const char *rev = getenv("BENCH_REV");
+    fputs("{\"bench\":", f);
+    bench_json_string(f, BENCH_NAME);
+    fputs(",\"name\":", f);
+    bench_json_string(f, name);
+    if (rev != NULL && *rev != '\0') {
+        fputs(",\"rev\":", f);
+        bench_json_string(f, rev);
+    }
+    fprintf(f, ",\"iterations\":%zu,\"median_ns\":%.0f,\"p99_ns\":%.0f", n, median, p99);
+    if (mbps > 0)
+        fprintf(f, ",\"mb_per_s\":%.1f", mbps);
+    fputs("}\n", f);
+    fclose(f);
+}
+
+/**
+ * Prints median/p99 per iteration for `samples` (sorted in place).
+ * When `bytes` is non-zero it is the data processed per iteration and a
+ * throughput figure based on the median is added.
+ */
+static inline void bench_report(const char *name, double *samples, size_t n, double bytes)
+{
+    qsort(samples, n, sizeof(double), bench_cmp_double);
+    double median = samples[n / 2];
+    double p99 = samples[(size_t)(n * 0.99) < n ? (size_t)(n * 0.99) : n - 1];
+
+    double mbps = bytes > 0 ? bytes / (median / 1e9) / 1e6 : 0;
+
+    printf("%-28s iterations=%-7zu median=%.0fns p99=%.0fns", name, n, median, p99);
+    if (mbps > 0)
+        printf(" throughput=%.1fMB/s", mbps);
+    printf("\n");
+    bench_json(name, n, median, p99, mbps);
+}
@@ -0,0 +1,74 @@
+/* 10k invocations of echo, printf, test and true as builtins (run in the
+ * shell with stdout swapped to /dev/null, as for `echo hi > /dev/null`)
+ * against the external binaries launched and waited for.
+ */
+
+#include "bench.h"
+#include "builtins.h"
+#include "launch.h"
+#include "path.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define INVOCATIONS 10000
+
+static char *echo_argv[]   = { "echo", "hello", "world", NULL };
+static char *printf_argv[] = { "printf", "%s=%d\\n", "x", "42", NULL };
+static char *test_argv[]   = { "test", "3", "-lt", "10", NULL };
+static char *true_argv[]   = { "true", NULL };
+
+static void compare(shell_t *sh, char **argv, int devnull)
+{
+    double *samples = malloc(INVOCATIONS * sizeof(double));
+    char name[64];
+
+    for (int i = 0; i < INVOCATIONS; i++) {
+        double start = bench_now_ns();
+        int status;
+        run_builtin(sh, argv, -1, devnull, NULL, &status);
+        samples[i] = bench_now_ns() - start;
+    }
+    snprintf(name, sizeof(name), "%s (builtin)", argv[0]);
+    bench_report(name, samples, INVOCATIONS, 0);
+
+    char *path = search_path(argv[0]);
+    if (path == NULL) {
+        printf("%-28s not found in PATH\n", argv[0]);
+        free(samples);
+        return;
+    }
+    launch_t l = { path, argv, -1, devnull, -1, NULL };
+    for (int i = 0; i < INVOCATIONS; i++) {
+        double start = bench_now_ns();
+        pid_t pid = launch(&l);
+        waitpid(pid, NULL, 0);
+        samples[i] = bench_now_ns() - start;
+    }
+    snprintf(name, sizeof(name), "%s (%s)", argv[0], path);
+    bench_report(name, samples, INVOCATIONS, 0);
+
+    free(path);
+    free(samples);
+}
+
+int main(void)
+{
+    launch_init();
+    int devnull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    command_history_t history;
+    history_open(&history, false);
+    job_list_t jobs = {0};
+    shell_t sh = { .jobs = &jobs, .history = &history };
+
+    compare(&sh, echo_argv, devnull);
+    compare(&sh, printf_argv, devnull);
+    compare(&sh, test_argv, devnull);
+    compare(&sh, true_argv, devnull);
+
+    history_close(&history);
+    close(devnull);
+    return 0;
+}
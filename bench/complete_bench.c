@@ -0,0 +1,83 @@
+/* Command-name completion over PATH: served from the inotify-maintained
+ * index (pathindex.h) against reading every PATH directory per request,
+ * which is what completion costs without it.
+ */
+
+#include "bench.h"
+#include "path.h"
+#include "vars.h"
+
+#include <dirent.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define ITERATIONS 200
+
+static void count_name(const char *name, void *arg)
+{
+    (void)name;
+    (*(size_t *)arg)++;
+}
+
+// The same answer without an index: readdir, then stat and access per match
+static size_t scan_path(const char *prefix)
+{
+    char *path_env = strdup(vars_get("PATH"));
+    size_t len = strlen(prefix);
+    size_t matches = 0;
+    for (char *dir = strtok(path_env, ":"); dir; dir = strtok(NULL, ":")) {
+        DIR *d = opendir(dir);
+        if (d == NULL)
+            continue;
+        struct dirent *ent;
+        while ((ent = readdir(d)) != NULL) {
+            if (strncmp(ent->d_name, prefix, len) != 0 || ent->d_type == DT_DIR)
+                continue;
+            char full_path[PATH_MAX];
+            struct stat st;
+            snprintf(full_path, sizeof(full_path), "%s/%s", dir, ent->d_name);
+            if (stat(full_path, &st) == 0 && S_ISREG(st.st_mode) && access(full_path, X_OK) == 0)
+                matches++;
+        }
+        closedir(d);
+    }
+    free(path_env);
+    return matches;
+}
+
+static void run(const char *name, const char *prefix, bool indexed)
+{
+    double samples[ITERATIONS];
+    size_t matches = 0;
+
+    for (int it = 0; it < ITERATIONS; it++) {
+        matches = 0;
+        double start = bench_now_ns();
+        if (indexed)
+            path_complete(prefix, count_name, &matches);
+        else
+            matches = scan_path(prefix);
+        samples[it] = bench_now_ns() - start;
+    }
+    bench_report(name, samples, ITERATIONS, 0);
+    printf("  %zu matches for \"%s\"\n", matches, prefix);
+}
+
+int main(void)
+{
+    vars_init();
+    if (vars_get("PATH") == NULL) {
+        printf("PATH is not set\n");
+        return 1;
+    }
+
+    run("complete \"\" scan", "", false);
+    run("complete \"\" index", "", true);
+    run("complete \"g\" scan", "g", false);
+    run("complete \"g\" index", "g", true);
+    run("complete \"gcc-\" scan", "gcc-", false);
+    run("complete \"gcc-\" index", "gcc-", true);
+    return 0;
+}
@@ -0,0 +1,136 @@
+/* `cat FILE > OUT` and `cp FILE OUT` run as builtins (copy_file_range in
+ * the shell, no fork) against the external cat and cp launched and waited
+ * for, on a 4K file (where the fork dominates) and a 64M one.
+ */
+
+#include "bench.h"
+#include "builtins.h"
+#include "launch.h"
+#include "path.h"
+#include "vars.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define MAX_ITERATIONS 2000
+
+static const struct { size_t size; int iterations; const char *label; } sizes[] = {
+    { 4 << 10, 2000, "4K" },
+    { 64 << 20, 20, "64M" },
+};
+
+static char src[] = "/tmp/copy_bench.XXXXXX";
+static char dest[sizeof(src) + 4];
+static size_t file_size;
+static int iterations;
+static const char *size_label;
+
+static void run_cat(shell_t *sh, const char *cat_path)
+{
+    double samples[MAX_ITERATIONS];
+    char *argv[] = { "cat", src, NULL };
+    char name[64];
+
+    for (int external = 0; external < 2; external++) {
+        for (int it = 0; it < iterations; it++) {
+            unlink(dest);   // truncating the last copy is not part of the copy
+            double start = bench_now_ns();
+            int out = open(dest, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (external) {
+                launch_t l = { cat_path, argv, -1, out, -1, NULL };
+                waitpid(launch(&l), NULL, 0);
+            } else {
+                int status;
+                run_builtin(sh, argv, -1, out, NULL, &status);
+            }
+            close(out);
+            samples[it] = bench_now_ns() - start;
+        }
+        snprintf(name, sizeof(name), "cat %s > file (%s)", size_label, external ? cat_path : "builtin");
+        bench_report(name, samples, iterations, file_size);
+    }
+}
+
+static void run_cp(shell_t *sh, const char *cp_path)
+{
+    double samples[MAX_ITERATIONS];
+    char *argv[] = { "cp", src, dest, NULL };
+    char name[64];
+
+    for (int external = 0; external < 2; external++) {
+        for (int it = 0; it < iterations; it++) {
+            unlink(dest);
+            double start = bench_now_ns();
+            if (external) {
+                launch_t l = { cp_path, argv, -1, -1, -1, NULL };
+                waitpid(launch(&l), NULL, 0);
+            } else {
+                int status;
+                run_builtin(sh, argv, -1, -1, NULL, &status);
+            }
+            samples[it] = bench_now_ns() - start;
+        }
+        snprintf(name, sizeof(name), "cp %s (%s)", size_label, external ? cp_path : "builtin");
+        bench_report(name, samples, iterations, file_size);
+    }
+}
+
+static bool make_source(size_t size)
+{
+    int fd = open(src, O_WRONLY | O_TRUNC | O_CLOEXEC);
+    char *block = malloc(1 << 20);
+    bool ok = fd >= 0;
+    for (size_t done = 0; ok && done < size; done += 1 << 20) {
+        size_t n = size - done < (1 << 20) ? size - done : (1 << 20);
+        memset(block, 'a' + done % 26, n);
+        ok = write(fd, block, n) == (ssize_t)n;
+    }
+    if (!ok)
+        perror(src);
+    free(block);
+    if (fd >= 0)
+        close(fd);
+    return ok;
+}
+
+int main(void)
+{
+    vars_init();
+    launch_init();
+
+    int fd = mkstemp(src);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    snprintf(dest, sizeof(dest), "%s.out", src);
+
+    command_history_t history;
+    history_open(&history, false);
+    job_list_t jobs = {0};
+    shell_t sh = { .jobs = &jobs, .history = &history };
+
+    char *cat_path = search_path("cat");
+    char *cp_path = search_path("cp");
+    if (cat_path == NULL || cp_path == NULL)
+        printf("cat or cp not found in PATH\n");
+    for (size_t i = 0; cat_path && cp_path && i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        file_size = sizes[i].size;
+        iterations = sizes[i].iterations;
+        size_label = sizes[i].label;
+        if (!make_source(file_size))
+            break;
+        run_cat(&sh, cat_path);
+        run_cp(&sh, cp_path);
+    }
+
+    free(cat_path);
+    free(cp_path);
+    unlink(src);
+    unlink(dest);
+    history_close(&history);
+    return 0;
+}
@@ -0,0 +1,94 @@
+/* The environment given to each command: the cached snapshot of the
+ * exported variables, the rebuild after an export changes it, and the
+ * envp of a `NAME=value cmd` override, with the startup environment
+ * padded to 200 exported variables. First checks that `Z=3 env` prints
+ * Z=3: the builtin is handed the override envp.
+ */
+
+#include "bench.h"
+#include "builtins.h"
+#include "vars.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define ITERATIONS 20000
+#define EXPORTED   200
+
+static char *override[] = { "LANG=C", "FOO=bar" };
+
+// `Z=3 env`, run as the shell runs it, must list Z=3
+static bool check_override(void)
+{
+    command_history_t history;
+    history_open(&history, false);
+    job_list_t jobs = {0};
+    shell_t sh = { .jobs = &jobs, .history = &history };
+    char *assignment[] = { "Z=3" };
+    char *argv[] = { "env", NULL };
+    char **envp = vars_environ_with(assignment, 1, false);
+
+    // the output stays well under a pipe's capacity
+    int fds[2];
+    int status = 1;
+    if (pipe(fds) < 0)
+        return false;
+    run_builtin(&sh, argv, -1, fds[1], envp, &status);
+    close(fds[1]);
+    FILE *f = fdopen(fds[0], "r");
+    char line[256];
+    bool found = false;
+    while (fgets(line, sizeof(line), f) != NULL)
+        found |= strcmp(line, "Z=3\n") == 0;
+    fclose(f);
+    free(envp);
+    history_close(&history);
+
+    if (status != 0 || !found)
+        printf("Z=3 env: Z=3 not in its output (status %d)\n", status);
+    return status == 0 && found;
+}
+
+int main(void)
+{
+    vars_init();
+    for (int i = 0; i < EXPORTED; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "BENCH_VAR_%d", i);
+        vars_set(name, "a value of some typical length", true);
+    }
+    if (!check_override())
+        return 1;
+    double *samples = malloc(ITERATIONS * sizeof(double));
+
+    vars_environ();
+    for (int it = 0; it < ITERATIONS; it++) {
+        double start = bench_now_ns();
+        vars_environ();
+        samples[it] = bench_now_ns() - start;
+    }
+    bench_report("envp cached", samples, ITERATIONS, 0);
+
+    for (int it = 0; it < ITERATIONS; it++) {
+        vars_set("BENCH_VAR_0", it % 2 ? "odd" : "even", true);
+        double start = bench_now_ns();
+        vars_environ();
+        samples[it] = bench_now_ns() - start;
+    }
+    bench_report("envp after export", samples, ITERATIONS, 0);
+
+    for (int it = 0; it < ITERATIONS; it++) {
+        double start = bench_now_ns();
+        free(vars_environ_with(override, 2, false));
+        samples[it] = bench_now_ns() - start;
+    }
+    bench_report("envp with 2 overrides", samples, ITERATIONS, 0);
+
+    size_t n = 0;
+    for (char **e = vars_environ(); *e != NULL; e++)
+        n++;
+    printf("%zu exported variables\n", n);
+    free(samples);
+    return 0;
+}
@@ -0,0 +1,121 @@
+/* Latency of running an external command to completion through
+ * execute_command(): launch, wait and job bookkeeping, with each launcher.
+ * Repeated after the process has grown a HEAP_MB heap, as a long-running
+ * shell does: fork() then copies its page tables, the zygote helper
+ * (started while the process was small) does not.
+ */
+
+#include "bench.h"
+#include "exec.h"
+#include "launch.h"
+#include "path.h"
+#include "vars.h"
+
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define ITERATIONS 2000
+#define HEAP_MB    512
+
+static const char *modes[] = { "spawn", "fork", "zygote" };
+#define NMODES (sizeof(modes) / sizeof(modes[0]))
+
+static void run(const char *mode, char *cmd_path, char *out_file, const char *heap, job_list_t *jobs)
+{
+    double samples[ITERATIONS];
+    char name[64];
+    tokenlist *tokens = new_tokenlist();
+    add_token(tokens, "true");
+
+    launch_set_mode(mode);
+    for (int it = 0; it < ITERATIONS; it++) {
+        double start = bench_now_ns();
+        execute_command(cmd_path, tokens, NULL, false, jobs, NULL, out_file, NULL);
+        samples[it] = bench_now_ns() - start;
+    }
+    snprintf(name, sizeof(name), "true%s (%s, %s heap)", out_file ? " > file" : "", mode, heap);
+    bench_report(name, samples, ITERATIONS, 0);
+    free_tokens(tokens);
+}
+
+/**
+ * Not timed: each launcher must start commands in the shell's current
+ * directory, which the zygote helper does not share. Runs pwd from a
+ * fresh directory and compares.
+ */
+static bool check_cwd(const char *mode, job_list_t *jobs)
+{
+    char *pwd_path = search_path("pwd");
+    char dir[] = "/tmp/exec_bench.XXXXXX";
+    char start[PATH_MAX];
+    if (pwd_path == NULL || getcwd(start, sizeof(start)) == NULL || mkdtemp(dir) == NULL ||
+        chdir(dir) < 0) {
+        free(pwd_path);
+        return false;
+    }
+    tokenlist *tokens = new_tokenlist();
+    add_token(tokens, "pwd");
+    add_token(tokens, "-P");
+    launch_set_mode(mode);
+    execute_command(pwd_path, tokens, NULL, false, jobs, NULL, "cwd.out", NULL);
+    free_tokens(tokens);
+    free(pwd_path);
+
+    char cwd[PATH_MAX], got[PATH_MAX] = "";
+    FILE *f = fopen("cwd.out", "r");
+    if (f != NULL) {
+        if (fgets(got, sizeof(got), f) != NULL)
+            got[strcspn(got, "\n")] = '\0';
+        fclose(f);
+    }
+    bool ok = getcwd(cwd, sizeof(cwd)) != NULL && strcmp(got, cwd) == 0;
+    if (!ok)
+        printf("%s: command ran in '%s', shell is in '%s'\n", mode, got, cwd);
+    unlink("cwd.out");
+    if (chdir(start) < 0)
+        return false;
+    rmdir(dir);
+    return ok;
+}
+
+int main(void)
+{
+    vars_init();
+    launch_init();
+    job_list_t jobs = {0};
+
+    // started now, while this process is small, as the shell does at startup
+    if (!launch_set_mode("zygote"))
+        return 1;
+
+    for (size_t m = 0; m < NMODES; m++)
+        if (!check_cwd(modes[m], &jobs))
+            return 1;
+
+    char *cmd_path = search_path("true");
+    if (cmd_path == NULL) {
+        printf("true not found in PATH\n");
+        return 1;
+    }
+
+    for (size_t m = 0; m < NMODES; m++)
+        run(modes[m], cmd_path, NULL, "small", &jobs);
+    for (size_t m = 0; m < NMODES; m++)
+        run(modes[m], cmd_path, "/dev/null", "small", &jobs);
+
+    // 4K pages, as a heap of many small allocations mostly is
+    size_t heap_size = (size_t)HEAP_MB << 20;
+    char *heap = mmap(NULL, heap_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    madvise(heap, heap_size, MADV_NOHUGEPAGE);
+    memset(heap, 1, heap_size);
+    char label[16];
+    snprintf(label, sizeof(label), "%dM", HEAP_MB);
+    for (size_t m = 0; m < NMODES; m++)
+        run(modes[m], cmd_path, NULL, label, &jobs);
+
+    munmap(heap, heap_size);
+    free(cmd_path);
+    return 0;
+}
@@ -0,0 +1,95 @@
+/* History lookups over a 100k-entry ring: !prefix recall and history -s
+ * substring search through the trigram index, against a linear scan of
+ * the ring with history_get().
+ */
+
+#include "bench.h"
+#include "history.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#define ENTRIES    99999
+#define ITERATIONS 200
+
+static const char *commands[] = {
+    "git", "make", "ls", "grep", "cd", "vim", "ssh", "docker", "kubectl", "python3",
+};
+static const char *args[] = {
+    "status", "-j8", "-la", "-rn TODO src", "/var/log", "include/lexer.h",
+    "build01.example.org", "ps -a", "get pods -n prod", "bench/run.py --fast",
+};
+
+// The lookup history_find_prefix() replaces: newest entry first, every entry read
+static bool scan_prefix(const command_history_t *h, const char *prefix, char *buf, size_t size)
+{
+    size_t n = strlen(prefix);
+    for (uint64_t seq = history_end(h); seq-- > 0;)
+        if (history_get(h, seq, buf, size) >= 0 && strncmp(buf, prefix, n) == 0)
+            return true;
+    return false;
+}
+
+int main(void)
+{
+    setenv("HISTSIZE", "100000", 1);
+    command_history_t h;
+    history_open(&h, false);
+
+    // The entry looked up is the oldest, the linear scan's worst case
+    add_to_history(&h, "tar czf backup-rare.tgz /srv");
+
+    char line[256];
+    unsigned seed = 7;
+    for (int i = 0; i < ENTRIES; i++) {
+        seed = seed * 1103515245 + 12345;
+        unsigned c = (seed >> 16) % 10;
+        seed = seed * 1103515245 + 12345;
+        snprintf(line, sizeof(line), "%s %s %u", commands[c], args[(seed >> 16) % 10], i);
+        add_to_history(&h, line);
+    }
+
+    static double samples[ITERATIONS];
+    char buf[HIST_MAX_LINE];
+
+    // The first search builds the index
+    double start = bench_now_ns();
+    history_find_prefix(&h, "ta", buf, sizeof(buf));
+    printf("index build: %.1fms for %d entries\n", (bench_now_ns() - start) / 1e6, ENTRIES + 1);
+
+    for (int it = 0; it < ITERATIONS; it++) {
+        start = bench_now_ns();
+        if (!history_find_prefix(&h, "tar cz", buf, sizeof(buf)))
+            return 1;
+        samples[it] = bench_now_ns() - start;
+    }
+    bench_report("!tar cz (index)", samples, ITERATIONS, 0);
+
+    for (int it = 0; it < ITERATIONS; it++) {
+        start = bench_now_ns();
+        if (!scan_prefix(&h, "tar cz", buf, sizeof(buf)))
+            return 1;
+        samples[it] = bench_now_ns() - start;
+    }
+    bench_report("!tar cz (linear scan)", samples, ITERATIONS, 0);
+
+    // history -s prints its matches; send them to /dev/null
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, STDOUT_FILENO);
+    for (int it = 0; it < ITERATIONS; it++) {
+        start = bench_now_ns();
+        history_print(&h, "backup-rare");
+        fflush(stdout);
+        samples[it] = bench_now_ns() - start;
+    }
+    dup2(saved, STDOUT_FILENO);
+    close(devnull);
+    close(saved);
+    bench_report("history -s backup-rare", samples, ITERATIONS, 0);
+
+    history_close(&h);
+    return 0;
+}
@@ -0,0 +1,116 @@
+/* Job table churn: add_job(), find_job() and remove_job() on a table of
+ * JOBS synthetic jobs, then check_jobs() reaping batches of real
+ * background children that have already exited. First checks what
+ * `wait -n` returns with and without a job to wait for.
+ */
+
+#include "bench.h"
+#include "job.h"
+#include "launch.h"
+#include "path.h"
+#include "vars.h"
+
+#include <sys/wait.h>
+
+#define JOBS       1000
+#define ITERATIONS 500
+#define REAP_BATCH 32
+#define REAP_ITERATIONS 200
+
+// `false & wait -n` is 1; `wait -n` with no jobs left is 127
+static bool check_wait_any(job_list_t *jobs, char *false_path)
+{
+    char *argv[] = { "false", NULL };
+    launch_t l = { false_path, argv, -1, -1, -1, NULL };
+    pid_t pid = launch(&l);
+    add_job(jobs, &pid, 1, "false &");
+    int status = wait_jobs(jobs, NULL, 0, true);
+    int none = wait_jobs(jobs, NULL, 0, true);
+    if (status != 1 || none != 127)
+        printf("wait -n: %d with a job, %d without (want 1, 127)\n", status, none);
+    return status == 1 && none == 127;
+}
+
+static void churn(job_list_t *jobs)
+{
+    double add[ITERATIONS], find[ITERATIONS], removed[ITERATIONS];
+    job_t *added[JOBS];
+
+    for (int it = 0; it < ITERATIONS; it++) {
+        // pids far above pid_max, so they can never match a real child
+        double start = bench_now_ns();
+        for (int j = 0; j < JOBS; j++) {
+            pid_t pid = 1 << 30 | j;
+            added[j] = add_job(jobs, &pid, 1, "sleep 1");
+        }
+        add[it] = (bench_now_ns() - start) / JOBS;
+
+        start = bench_now_ns();
+        for (int j = 0; j < JOBS; j++)
+            if (find_job(jobs, added[j]->job_num) != added[j])
+                abort();
+        find[it] = (bench_now_ns() - start) / JOBS;
+
+        // oldest first, as completions usually arrive
+        start = bench_now_ns();
+        for (int j = 0; j < JOBS; j++)
+            remove_job(jobs, added[j]);
+        removed[it] = (bench_now_ns() - start) / JOBS;
+    }
+    bench_report("add_job", add, ITERATIONS, 0);
+    bench_report("find_job", find, ITERATIONS, 0);
+    bench_report("remove_job", removed, ITERATIONS, 0);
+}
+
+static void reap(job_list_t *jobs, char *cmd_path)
+{
+    double samples[REAP_ITERATIONS];
+    char *argv[] = { "true", NULL };
+    launch_t l = { cmd_path, argv, -1, -1, -1, NULL };
+
+    for (int it = 0; it < REAP_ITERATIONS; it++) {
+        pid_t pids[REAP_BATCH];
+        for (int j = 0; j < REAP_BATCH; j++) {
+            pids[j] = launch(&l);
+            add_job(jobs, &pids[j], 1, "true &");
+        }
+        // wait for every child to exit without reaping it
+        for (int j = 0; j < REAP_BATCH; j++) {
+            siginfo_t info;
+            waitid(P_PID, pids[j], &info, WEXITED | WNOWAIT);
+        }
+
+        double start = bench_now_ns();
+        int finished = check_jobs(jobs);
+        samples[it] = (bench_now_ns() - start) / REAP_BATCH;
+        if (finished != REAP_BATCH)
+            abort();
+    }
+    bench_report("check_jobs (per job)", samples, REAP_ITERATIONS, 0);
+}
+
+int main(void)
+{
+    vars_init();
+    launch_init();
+    jobs_init_signals();
+    job_list_t jobs = {0};
+
+    char *cmd_path = search_path("true");
+    char *false_path = search_path("false");
+    if (cmd_path == NULL || false_path == NULL) {
+        printf("%s not found in PATH\n", cmd_path == NULL ? "true" : "false");
+        return 1;
+    }
+    bool ok = check_wait_any(&jobs, false_path);
+    free(false_path);
+    if (!ok)
+        return 1;
+
+    churn(&jobs);
+    reap(&jobs, cmd_path);
+
+    free(cmd_path);
+    free_jobs(&jobs);
+    return 0;
+}
@@ -0,0 +1,111 @@
+/* Tokenizer throughput over a corpus of long command lines.
+ * Compares get_tokens() with the strtok/realloc tokenizer it replaced,
+ * then times expand_tokens() on its output.
+ */
+
+#include "bench.h"
+#include "lexer.h"
+#include "vars.h"
+
+#include <string.h>
+
+#define CORPUS_LINES 200
+#define LINE_WORDS   400
+#define ITERATIONS   200
+
+static const char *words[] = {
+    "grep", "-v", "'^#'", "\"$HOME/logs\"", "|", "sort", "-k2,2n", "<", "input.txt",
+    "awk", "'{print $1}'", ">", "out.txt", "a\\ b", "--long-option=value", "&",
+    "${USER}_$$.tmp", "~/bin", "$?",
+};
+
+/* The previous tokenizer: copy, strtok, and a realloc + malloc per token */
+static tokenlist *legacy_get_tokens(char *input)
+{
+    char *buf = malloc(strlen(input) + 1);
+    strcpy(buf, input);
+    tokenlist *tokens = malloc(sizeof(tokenlist));
+    tokens->size = 0;
+    tokens->items = malloc(sizeof(char *));
+    tokens->items[0] = NULL;
+    for (char *tok = strtok(buf, " "); tok != NULL; tok = strtok(NULL, " ")) {
+        size_t i = tokens->size;
+        tokens->items = realloc(tokens->items, (i + 2) * sizeof(char *));
+        tokens->items[i] = malloc(strlen(tok) + 1);
+        tokens->items[i + 1] = NULL;
+        strcpy(tokens->items[i], tok);
+        tokens->size++;
+    }
+    free(buf);
+    return tokens;
+}
+
+static void legacy_free_tokens(tokenlist *tokens)
+{
+    for (size_t i = 0; i < tokens->size; i++)
+        free(tokens->items[i]);
+    free(tokens->items);
+    free(tokens);
+}
+
+int main(void)
+{
+    char *corpus[CORPUS_LINES];
+    double bytes = 0;
+    unsigned seed = 42;
+
+    for (int l = 0; l < CORPUS_LINES; l++) {
+        size_t cap = LINE_WORDS * 24, len = 0;
+        corpus[l] = malloc(cap);
+        for (int w = 0; w < LINE_WORDS; w++) {
+            seed = seed * 1103515245 + 12345;
+            len += snprintf(corpus[l] + len, cap - len, "%s ",
+                            words[(seed >> 16) % (sizeof(words) / sizeof(words[0]))]);
+        }
+        bytes += len;
+    }
+
+    double samples[ITERATIONS];
+    size_t ntokens = 0;
+
+    for (int it = 0; it < ITERATIONS; it++) {
+        double start = bench_now_ns();
+        for (int l = 0; l < CORPUS_LINES; l++) {
+            tokenlist *tokens = get_tokens(corpus[l]);
+            ntokens += tokens->size;
+            free_tokens(tokens);
+        }
+        samples[it] = bench_now_ns() - start;
+    }
+    bench_report("get_tokens", samples, ITERATIONS, bytes);
+
+    for (int it = 0; it < ITERATIONS; it++) {
+        double start = bench_now_ns();
+        for (int l = 0; l < CORPUS_LINES; l++)
+            legacy_free_tokens(legacy_get_tokens(corpus[l]));
+        samples[it] = bench_now_ns() - start;
+    }
+    bench_report("strtok tokenizer (legacy)", samples, ITERATIONS, bytes);
+
+    // Expansion alone: each line is tokenized outside the timed region
+    vars_init();
+    for (int it = 0; it < ITERATIONS; it++) {
+        double elapsed = 0;
+        for (int l = 0; l < CORPUS_LINES; l++) {
+            tokenlist *tokens = get_tokens(corpus[l]);
+            double start = bench_now_ns();
+            expand_tokens(tokens);
+            elapsed += bench_now_ns() - start;
+            free_tokens(tokens);
+        }
+        samples[it] = elapsed;
+    }
+    bench_report("expand_tokens", samples, ITERATIONS, bytes);
+
+    printf("corpus: %d lines, %.0f bytes, %zu tokens per pass\n",
+           CORPUS_LINES, bytes, ntokens / ITERATIONS);
+
+    for (int l = 0; l < CORPUS_LINES; l++)
+        free(corpus[l]);
+    return 0;
+}
@@ -0,0 +1,56 @@
+/* search_path() cost: cached hits and misses, and cold lookups that
+ * re-split PATH and walk its directories (the first command after
+ * `hash -r` or a PATH change).
+ */
+
+#include "bench.h"
+#include "path.h"
+#include "vars.h"
+
+#include <string.h>
+
+#define ITERATIONS 2000
+#define BATCH      100     // lookups per sample, so timer overhead stays small
+
+static void run(const char *name, const char *command, bool cold)
+{
+    double samples[ITERATIONS];
+    size_t batch = cold ? 1 : BATCH;
+
+    for (int it = 0; it < ITERATIONS; it++) {
+        double elapsed = 0;
+        for (size_t i = 0; i < batch; i++) {
+            if (cold)
+                path_cache_clear();
+            double start = bench_now_ns();
+            free(search_path(command));
+            elapsed += bench_now_ns() - start;
+        }
+        samples[it] = elapsed / batch;
+    }
+    bench_report(name, samples, ITERATIONS, 0);
+}
+
+int main(void)
+{
+    vars_init();
+    const char *path_env = vars_get("PATH");
+    size_t ndirs = 1;
+    for (const char *p = path_env ? path_env : ""; *p; p++)
+        ndirs += *p == ':';
+
+    char *sh = search_path("sh");
+    if (sh == NULL) {
+        printf("sh not found in PATH\n");
+        return 1;
+    }
+
+    run("search_path hit", "sh", false);
+    run("search_path miss", "no-such-command", false);
+    run("search_path cold hit", "sh", true);
+    run("search_path cold miss", "no-such-command", true);
+
+    printf("PATH: %zu directories, sh resolves to %s\n", ndirs, sh);
+    free(sh);
+    return 0;
+}
@@ -0,0 +1,114 @@
+/* Throughput of data moved through pipeline() over a temporary file of
+ * FILE_SIZE bytes: two- and three-stage cat pipelines with the external
+ * cat and with the splice()-based builtin cat and tee, each at the default
+ * pipe size and with PIPESIZE=1M. Every pipeline ends in the external
+ * `wc -c`, which reads all of it: a last stage writing to /dev/null would
+ * let splice() drop the data unread.
+ */
+
+#include "bench.h"
+#include "exec.h"
+#include "launch.h"
+#include "path.h"
+#include "vars.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#define FILE_SIZE  (64 << 20)
+#define ITERATIONS 30
+
+static void run(const char *name, const char *line, const char *pipesize, shell_t *sh)
+{
+    double samples[ITERATIONS];
+    char buf[512];
+    char label[96];
+
+    if (pipesize)
+        vars_set("PIPESIZE", pipesize, false);
+    else
+        vars_unset("PIPESIZE");
+
+    for (int it = 0; it < ITERATIONS; it++) {
+        snprintf(buf, sizeof(buf), "%s", line);
+        tokenlist *tokens = get_tokens(buf);
+        int pipe_count = 0;
+        for (size_t i = 0; i < tokens->size; i++)
+            pipe_count += is_operator(tokens->items[i], "|");
+
+        double start = bench_now_ns();
+        pipeline(tokens, pipe_count, false, sh);
+        samples[it] = bench_now_ns() - start;
+        free_tokens(tokens);
+    }
+    snprintf(label, sizeof(label), "%s (%s pipes)", name, pipesize ? pipesize : "64K");
+    bench_report(label, samples, ITERATIONS, FILE_SIZE);
+}
+
+// `cat file | cat | ... | wc -c > /dev/null` with `stages` commands before
+// the wc, the second one tee when asked
+static void build(char *line, size_t size, const char *cat, const char *file, int stages, bool tee,
+                  const char *sink)
+{
+    int len = snprintf(line, size, "%s %s", cat, file);
+    for (int i = 1; i < stages; i++)
+        len += snprintf(line + len, size - len, " | %s", tee && i == 1 ? "tee" : cat);
+    snprintf(line + len, size - len, " | %s -c > /dev/null", sink);
+}
+
+int main(void)
+{
+    vars_init();
+    launch_init();
+
+    char file[] = "/tmp/pipeline_bench.XXXXXX";
+    int fd = mkstemp(file);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    char *block = malloc(1 << 20);
+    memset(block, 'x', 1 << 20);
+    for (int i = 0; i < FILE_SIZE >> 20; i++) {
+        if (write(fd, block, 1 << 20) != 1 << 20) {
+            perror("write");
+            unlink(file);
+            return 1;
+        }
+    }
+    free(block);
+    close(fd);
+
+    command_history_t history;
+    history_open(&history, false);
+    job_list_t jobs = {0};
+    shell_t sh = { .jobs = &jobs, .history = &history };
+
+    char *cat_path = search_path("cat");
+    char *wc_path = search_path("wc");
+    if (cat_path == NULL || wc_path == NULL) {
+        printf("%s not found in PATH\n", cat_path == NULL ? "cat" : "wc");
+        unlink(file);
+        return 1;
+    }
+
+    static const char *sizes[] = { NULL, "1M" };
+    char line[512];
+    for (int s = 0; s < 2; s++) {
+        build(line, sizeof(line), cat_path, file, 3, false, wc_path);
+        run("external cat x3", line, sizes[s], &sh);
+        build(line, sizeof(line), "cat", file, 2, false, wc_path);
+        run("cat | cat", line, sizes[s], &sh);
+        build(line, sizeof(line), "cat", file, 3, false, wc_path);
+        run("cat | cat | cat", line, sizes[s], &sh);
+        build(line, sizeof(line), "cat", file, 4, true, wc_path);
+        run("cat | tee | cat | cat", line, sizes[s], &sh);
+    }
+
+    free(cat_path);
+    free(wc_path);
+    unlink(file);
+    history_close(&history);
+    return 0;
+}
@@ -0,0 +1,84 @@
+/* Commands per second for a file of trivial commands, run as
+ * `shell file` (script mode) and as `shell -i < file` (interactive path:
+ * prompt and job polling on every line). Run from the repo root.
+ */
+
+#include "bench.h"
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define RUNS 7
+
+extern char **environ;
+
+static void write_script(const char *path, const char *line, int count)
+{
+    FILE *f = fopen(path, "w");
+    for (int i = 0; i < count; i++)
+        fprintf(f, "%s\n", line);
+    fclose(f);
+}
+
+static double run_shell(char **argv, const char *stdin_path)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    if (stdin_path)
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, stdin_path, O_RDONLY, 0);
+
+    double start = bench_now_ns();
+    pid_t pid;
+    if (posix_spawn(&pid, argv[0], &actions, NULL, argv, environ) != 0) {
+        perror("posix_spawn ./shell");
+        exit(1);
+    }
+    waitpid(pid, NULL, 0);
+    double elapsed = bench_now_ns() - start;
+
+    posix_spawn_file_actions_destroy(&actions);
+    return elapsed;
+}
+
+static void compare(const char *label, const char *line, int count)
+{
+    char path[] = "/tmp/script_benchXXXXXX";
+    int fd = mkstemp(path);
+    close(fd);
+    write_script(path, line, count);
+
+    char *script_argv[] = { "./shell", path, NULL };
+    char *interactive_argv[] = { "./shell", "-i", NULL };
+    double samples[RUNS];
+    char name[64];
+
+    for (int r = 0; r < RUNS; r++)
+        samples[r] = run_shell(script_argv, NULL);
+    snprintf(name, sizeof(name), "%s script", label);
+    bench_report(name, samples, RUNS, 0);
+    printf("%-28s %.0f commands/s\n", "", count / (samples[RUNS / 2] / 1e9));
+
+    for (int r = 0; r < RUNS; r++)
+        samples[r] = run_shell(interactive_argv, path);
+    snprintf(name, sizeof(name), "%s interactive", label);
+    bench_report(name, samples, RUNS, 0);
+    printf("%-28s %.0f commands/s\n", "", count / (samples[RUNS / 2] / 1e9));
+
+    unlink(path);
+}
+
+int main(void)
+{
+    if (access("./shell", X_OK) != 0) {
+        fprintf(stderr, "script_bench: build ./shell first (make)\n");
+        return 1;
+    }
+
+    compare("cd . (builtin)", "cd .", 20000);
+    compare("/bin/true", "/bin/true", 1000);
+    return 0;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include "job.h"
+#include "history.h"
+
+// The shell state builtins act on
+typedef struct {
+    job_list_t *jobs;
+    command_history_t *history;
+    bool interactive;           // exit prints the summary
+    bool should_exit;           // set by exit
+    bool found_command;         // the line ran a command that exists (history)
+    dev_t input_dev;            // the file commands are read from,
+    ino_t input_ino;            // or 0 for -c (see builtin_parallel)
+} shell_t;
+
+// argv[0] names a builtin (or is a NAME=value assignment)
+bool is_builtin(const char *name);
+
+/**
+ * Runs argv (NULL-terminated) in the shell itself if it is a builtin.
+ * in_fd and out_fd (-1 for none) replace stdin and stdout only while it
+ * runs: the originals are saved with dup and put back afterwards, so a
+ * redirected builtin still affects the shell and needs no fork. envp,
+ * unless NULL, is the environment of the commands it starts (NAME=value
+ * words before it, see vars_override_environ()).
+ * Returns false if it is not a builtin; otherwise stores its exit status
+ * in *status.
+ */
+bool run_builtin(shell_t *sh, char **argv, int in_fd, int out_fd, char **envp, int *status);
+
+/**
+ * Runs a builtin in a forked child with in_fd/out_fd as its stdin and
+ * stdout, for pipeline stages that must run concurrently with the rest.
+ * Returns the child's pid, or -1.
+ */
+pid_t fork_builtin(shell_t *sh, char **argv, int in_fd, int out_fd, char **envp);
+
+// Shared by the exit builtin and end of input
+void exit_shell(shell_t *sh);
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+
+/**
+ * Moving data between file descriptors for the cat, cp and tee builtins,
+ * without it entering user space where the kernel allows:
+ * copy_file_range() between regular files, sendfile() from a regular
+ * file to anything else (pipes, sockets), splice() when a pipe is
+ * involved, and tee() to fan a pipe out. Each step continues from the
+ * descriptors' current offsets where the one before stopped, ending with
+ * read()/write() through a large buffer, which reports the failing side.
+ */
+typedef enum {
+    COPY_OK,
+    COPY_READ_ERROR,    // errno is set
+    COPY_WRITE_ERROR    // errno is set
+} copy_result;
+
+// Copies in_fd to out_fd until end of input
+copy_result copy_fd(int in_fd, int out_fd);
+
+typedef struct {
+    int fd;
+    int error;          // errno of the first failed write, 0 if none
+} tee_out;
+
+/**
+ * Copies in_fd to every output until end of input. An output whose write
+ * fails gets its error recorded and is skipped from then on; the copy
+ * stops early once every output has failed.
+ * Returns COPY_READ_ERROR if reading fails, COPY_OK otherwise.
+ */
+copy_result tee_fds(int in_fd, tee_out *outs, int nouts);
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "lexer.h"
+#include "job.h"
+#include "timeout.h"
+#include "builtins.h"
+#include "parser.h"
+
+/**
+ * Running commands: the plan executor and the paths it dispatches to.
+ * Kept out of main.c so the benchmarks can drive them directly.
+ */
+int execute_command(char *cmd_path, tokenlist *tokens, const timeout_spec *timeout, bool background, job_list_t *jobs, char *in_file, char *out_file, char **envp);
+int pipeline(tokenlist *tokens, int pipe_count, bool background, shell_t *sh);
+int i_o_redirection(char *in_file, char *out_file, int *in_fd, int *out_fd);
+
+// Executes plan nodes [pc, end) with $? = status; returns the last status
+int run_plan(shell_t *sh, plan_t *plan, size_t pc, size_t end, int status);
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define HISTSIZE_DEFAULT 100000
+#define HIST_MAX_LINE 4096      // longer commands are truncated
+
+struct hist_header;
+struct hist_slot;
+struct hist_index;
+
+/**
+ * Command history in a memory-mapped, append-only ring ($HISTFILE,
+ * default ~/.shell_history) shared by every shell that maps it.
+ *
+ * Appends take no locks: a writer reserves a sequence number and a range
+ * of the text ring with atomic fetch-adds, copies the text and publishes
+ * the index slot last. Readers validate each entry against its slot's
+ * sequence number, so entries overwritten after HISTSIZE more commands
+ * (or a wrapped text ring) simply read as gone. Opening the file parses
+ * nothing; entries are only touched when they are looked up.
+ */
+typedef struct {
+    struct hist_header *hdr;
+    struct hist_slot *slots;
+    char *text;
+    size_t map_size;
+    uint64_t session_start;     // first sequence number of this session
+    pid_t pid;                  // marks this session's entries
+    struct hist_index *index;   // trigram index, built on the first search
+} command_history_t;
+
+/**
+ * Maps the history file (persistent is false, or the file cannot be
+ * used: a private anonymous ring of the same layout). The depth is
+ * $HISTSIZE entries for a new file; an existing file keeps its own.
+ */
+void history_open(command_history_t *history, bool persistent);
+void history_close(command_history_t *history);
+
+void add_to_history(command_history_t *history, const char *cmd);
+void display_history(command_history_t *history);   // this session's last 3
+
+uint64_t history_end(const command_history_t *history);    // next sequence number
+uint64_t history_capacity(const command_history_t *history);
+
+/**
+ * Copies entry `seq` into buf (truncated to size - 1, NUL-terminated).
+ * Returns its length, or -1 if the entry was never written or has since
+ * been overwritten.
+ */
+ssize_t history_get(const command_history_t *history, uint64_t seq, char *buf, size_t size);
+
+/**
+ * Searches go through a trigram index over the entries (each entry
+ * starts with two sentinel characters, so prefixes have trigrams too).
+ * It is built on the first search and then extended by add_to_history()
+ * and by each search picking up other sessions' appends.
+ */
+void history_print(command_history_t *history, const char *pattern);   // history [-s PATTERN]
+
+/**
+ * Copies the newest entry starting with prefix ("" matches the newest
+ * entry, as !!) into buf. Returns false if there is none.
+ */
+bool history_find_prefix(command_history_t *history, const char *prefix, char *buf, size_t size);
@@ -1,12 +1,77 @@
-typedef struct {
+#pragma once
+
+#include <stdbool.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+struct job;
+
+typedef struct process {
+    pid_t pid;
+    int status;             // exit status ($?) once reaped
+    bool done;
+    struct rusage usage;    // from wait4() once reaped
+    struct timespec ended;  // when it was reaped (CLOCK_MONOTONIC)
+    struct job *job;
+    struct process *chain;  // Next process in the same by_pid bucket
+} process_t;
+
+typedef struct job {
     int job_num;          // Job number (1, 2, 3, ...)
-    pid_t pid;            // Process ID
+    pid_t pid;            // Process ID (last stage for pipelines)
     char *command;        // Full command line
     int status;           // 0=running, non-zero=exit status
+    bool quiet;           // Completion handled by a builtin, not announced
+    bool timed;           // Started with the time prefix: report usage
+    struct timespec started;
+
+    process_t *procs;     // One per pipeline stage
+    int nprocs;
+    int nlive;            // Stages not yet reaped
+
+    struct job *prev;     // Jobs in start order (for listing)
+    struct job *next;
+    struct job *num_chain;  // Next job in the same by_num bucket
 } job_t;
 
+/**
+ * Background jobs, with no upper limit. Jobs are kept in start order on a
+ * doubly linked list and indexed by process pid and by job number, so
+ * adding, finding and removing a job are all O(1).
+ */
 typedef struct {
-    job_t jobs[10];       // Max 10 concurrent background jobs
+    job_t *head;          // Oldest job
+    job_t *tail;          // Newest job
+    process_t **by_pid;   // Hash buckets keyed by process pid
+    job_t **by_num;       // Hash buckets keyed by job number
+    size_t nbuckets;      // Size of both tables (power of two)
     int count;            // Number of active jobs
+    int nprocs;           // Processes across all jobs
     int next_job_num;     // Next job number to assign
-} job_list_t;
\ No newline at end of file
+    bool notify;          // Print start/completion notices (interactive)
+    bool time_next;       // Set by the time prefix for the command being run
+} job_list_t;
+
+job_t *new_job(const pid_t *pids, int npids, const char *cmd);
+void free_job(job_t *job);
+int wait_foreground(job_t *job);
+job_t *add_job(job_list_t *jobs, const pid_t *pids, int npids, const char *cmd);
+job_t *find_job(job_list_t *jobs, int job_num);
+job_t *find_job_by_pid(job_list_t *jobs, pid_t pid);
+void remove_job(job_list_t *jobs, job_t *job);
+void free_jobs(job_list_t *jobs);
+
+int exit_status(int status);
+
+/**
+ * Reaping is driven by SIGCHLD: the signal is blocked and delivered
+ * through a signalfd, which the input loop polls alongside stdin.
+ * Returns the signalfd.
+ */
+int jobs_init_signals(void);
+int check_jobs(job_list_t *jobs);
+job_t *wait_any_job(job_list_t *jobs);
+void finish_job(job_list_t *jobs, job_t *job);
+void wait_for_jobs(job_list_t *jobs);
+int wait_jobs(job_list_t *jobs, const int *job_nums, int n, bool any);
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+typedef enum {
+    LAUNCH_SPAWN,   // posix_spawn (vfork-style clone, no page-table copy)
+    LAUNCH_FORK,    // classic fork() + execve()
+    LAUNCH_ZYGOTE   // forked by a small helper process (see zygote.h)
+} launch_mode_t;
+
+extern launch_mode_t launch_mode;
+
+/**
+ * Everything a child needs, prepared by the parent before launching.
+ * The child only installs the fds and execs; nothing is allocated or
+ * resolved after the process is created.
+ */
+typedef struct {
+    const char *path;   // resolved executable (from search_path)
+    char **argv;        // NULL-terminated argument vector
+    int in_fd;          // installed as stdin when >= 0
+    int out_fd;         // installed as stdout when >= 0
+    int err_fd;         // installed as stderr when >= 0
+    char **envp;        // NULL: the exported variables (vars_environ())
+} launch_t;
+
+/**
+ * Starts the described process with the current launch_mode.
+ * Returns the child's pid, or -1 (after printing the error) on failure.
+ */
+pid_t launch(const launch_t *l);
+
+void launch_init(void);                     // reads $SHELL_LAUNCHER
+bool launch_set_mode(const char *name);     // "spawn", "fork" or "zygote"
+const char *launch_mode_name(void);
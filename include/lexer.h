@@ -3,18 +3,73 @@
 #include <stdlib.h>
 #include <stdbool.h>
 
+// Marks a quoted/escaped character so expansion leaves it alone;
+// expand_tokens() strips it afterwards.
+#define CTLESC '\001'
+
+struct token_chunk;
+
+// Why get_tokens() returned an empty list for a non-empty line
+typedef enum {
+    LEX_OK,
+    LEX_OPEN_QUOTE,     // the input ends inside quotes: the next line may close them
+} lex_status;
+
+/**
+ * Tokens are views into one allocation per line (the list header, the
+ * items array and the split characters share a block). Strings produced
+ * later, e.g. by expansion, come from tokens_alloc() and are released
+ * with the list; individual items are never freed.
+ */
 typedef struct {
     char ** items;
     size_t size;
+    size_t capacity;                // item slots, excluding the NULL terminator
+    struct token_chunk *extra;      // tokens_alloc() chunks
+    lex_status status;              // set by get_tokens()
+    char **assignments;             // set by expand_tokens(), see vars.h
+    size_t nassignments;
 } tokenlist;
 
+#define READER_BLOCK 65536
+
+/**
+ * Buffered line reader over a file descriptor. The buffer persists
+ * across calls and only grows when a single line outgrows it.
+ */
 typedef struct {
-    char *commands[3];  // Store last 3 commands
-    int count;          // Current number of commands stored
-} command_history_t;
+    int fd;
+    char *buf;
+    size_t cap;
+    size_t start;       // first unconsumed byte
+    size_t end;         // end of buffered data
+    bool eof;
+
+    // While waiting for input, notify_fd is polled too; on_notify runs
+    // whenever it becomes readable (e.g. the SIGCHLD signalfd)
+    int notify_fd;
+    void (*on_notify)(void *arg);
+    void *notify_arg;
+} line_reader;
 
+void reader_init(line_reader *r, int fd);
+void reader_init_string(line_reader *r, const char *s);
+char *reader_getline(line_reader *r, size_t *len);
+void reader_free(line_reader *r);
+
+// Next line from stdin, owned by the reader (do not free); NULL at EOF
 char * get_input(void);
 tokenlist * get_tokens(char *input);
 tokenlist * new_tokenlist(void);
 void add_token(tokenlist *tokens, char *item);
 void free_tokens(tokenlist *tokens);
+
+tokenlist * copy_tokens(char *const *items, size_t n);
+
+char *tokens_alloc(tokenlist *tokens, size_t len);
+char *tokens_strdup(tokenlist *tokens, const char *s);
+
+// Operator tokens (| < > & ; ( ) && || and newline) are shared static
+// strings, so a quoted "|" is never mistaken for a pipe.
+bool is_operator(const char *tok, const char *op);
+bool is_any_operator(const char *tok);
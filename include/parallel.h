@@ -0,0 +1,15 @@
+#pragma once
+
+#include "job.h"
+
+/**
+ * parallel [-j N] cmd [arg...] [::: value...]
+ * Runs cmd once per value (from ::: or one per line of stdin), replacing
+ * {} with the value or appending it when there is no {}. Keeps N jobs
+ * running (default: online CPUs) and prints each job's output in one
+ * piece when it finishes.
+ * Without ::: and with read_stdin false (stdin holds the shell's own
+ * commands), it fails with a usage error instead of reading them.
+ * Returns the number of failed jobs (at most 101), or 2 on usage errors.
+ */
+int parallel_builtin(int argc, char **argv, job_list_t *jobs, bool read_stdin);
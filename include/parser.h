@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "lexer.h"
+
+/**
+ * A command line compiled into a flat array of nodes. Pipelines refer to
+ * a range of the line's (unexpanded) tokens; control flow is explicit
+ * jumps between node indexes, so loop bodies are parsed once and then
+ * re-run by moving the program counter back.
+ *
+ * `a && b || c` compiles to
+ *     0 PIPELINE a    1 AND ->3    2 PIPELINE b    3 OR ->5    4 PIPELINE c
+ * and `while c; do b; done` to
+ *     0 LOOP ->2    1 PIPELINE c    2 BRANCH ->6    3 PIPELINE b
+ *     4 SAVE ->2    5 JUMP ->1
+ */
+typedef enum {
+    PLAN_PIPELINE,  // words[first, first + count): one pipeline; sets the status
+    PLAN_JUMP,      // continue at target
+    PLAN_AND,       // &&: continue at target unless the status is 0
+    PLAN_OR,        // ||: continue at target if the status is 0
+    PLAN_BRANCH,    // if/while test (until: negate): when false, the status
+                    // becomes `saved` and execution continues at target
+    PLAN_LOOP,      // entering a loop: resets the BRANCH or FOR at target
+    PLAN_SAVE,      // end of a loop body: target's `saved` = the status
+    PLAN_FOR,       // next of words[first, first + count) into $name, or
+                    // (when exhausted) status = saved and continue at target
+    PLAN_SUBSHELL   // nodes up to target run in a forked shell;
+                    // words[first, first + count) are its redirections
+} plan_op;
+
+typedef struct {
+    plan_op op;
+    bool background;    // PIPELINE, SUBSHELL: run as a job (&)
+    bool negate;        // PIPELINE: ! prefix; BRANCH: until
+    bool timed;         // PIPELINE, SUBSHELL: time prefix
+    size_t first;
+    size_t count;
+    size_t target;
+    size_t source;      // SUBSHELL: first token of its text (for jobs)
+    const char *name;   // FOR: the loop variable
+
+    // State while the plan runs
+    int saved;              // BRANCH, FOR: the status the loop leaves
+    tokenlist *values;      // FOR: the expanded words
+    size_t next_value;
+} plan_node;
+
+typedef struct {
+    plan_node *nodes;
+    size_t size;
+    size_t cap;
+    char **words;       // the tokens nodes refer to (not owned)
+} plan_t;
+
+typedef enum {
+    PARSE_OK,
+    PARSE_INCOMPLETE,   // the line ends inside a construct: read another
+    PARSE_ERROR         // reported on stderr
+} parse_result;
+
+/**
+ * Compiles tokens into plan. Reserved words (if then elif else fi for in
+ * do done while until { } !) and the time prefix are recognised in
+ * command position only. Compound commands cannot be pipeline stages,
+ * and only subshells take redirections.
+ */
+parse_result parse_plan(tokenlist *tokens, plan_t *plan);
+void free_plan(plan_t *plan);
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdbool.h>
+
+/**
+ * Resolves a command name against $PATH.
+ * Results (including "not found") are remembered in a hash table that is
+ * flushed when PATH changes or a PATH directory changes (reported by
+ * inotify, or seen in its mtime). Misses consult the directory listings
+ * of pathindex.h before touching the filesystem.
+ * Returns the full path if found, NULL otherwise.
+ * Caller must free the returned string.
+ */
+char *search_path(const char *command);
+
+/**
+ * Calls fn for each executable in PATH whose name starts with prefix,
+ * directory by directory: sorted within one, with duplicates across them.
+ */
+void path_complete(const char *prefix, void (*fn)(const char *name, void *arg), void *arg);
+
+void path_cache_clear(void);          // hash -r
+void path_cache_print(void);          // hash
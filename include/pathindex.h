@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+
+/**
+ * In-memory listing of the PATH directories, for completion and for
+ * search_path() misses.
+ *
+ * Each directory is read once, on first use, into a sorted array of its
+ * entry names; an inotify watch then reports creates, deletes, renames and
+ * permission changes, and a directory is only read again after one of
+ * those. Whether an entry is executable is checked when it is first asked
+ * for and remembered until its directory changes.
+ *
+ * Directories are named by a handle from path_index_dir(). Without
+ * inotify (or a watch on the directory) nothing is kept: lookups answer
+ * "unknown" and completion reads the directory each time.
+ */
+int path_index_dir(const char *dir);        // registers dir; does not read it
+
+/**
+ * Whether dir has an entry called name: 1 or 0, or -1 if the index cannot
+ * tell (the caller asks the filesystem). The entry may not be executable.
+ */
+int path_index_lists(int dir, const char *name);
+
+/**
+ * Calls fn for each executable in dir whose name starts with prefix, in
+ * sorted order. Returns false if the directory cannot be read.
+ */
+bool path_index_complete(int dir, const char *prefix,
+                         void (*fn)(const char *name, void *arg), void *arg);
+
+/**
+ * Takes in the inotify events that have arrived. Returns true if any
+ * directory changed; path_index_generation() tells which.
+ */
+bool path_index_poll(void);
+
+// Bumped each time a change to dir is reported
+unsigned path_index_generation(int dir);
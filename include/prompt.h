@@ -0,0 +1,18 @@
+#pragma once
+
+/**
+ * Prints the prompt with a single write().
+ * The format comes from $PS1 (default "\u@\h:\w> ") and is compiled into
+ * segments once; the rendered string is cached and rebuilt only when the
+ * format, $USER or $HOSTNAME change (see vars_generation()), or after
+ * prompt_invalidate().
+ *
+ * Escapes: \u user, \h host, \w working directory, \W its last component,
+ * \$ '#' for root and '$' otherwise, \n newline, \\ backslash.
+ */
+void print_prompt(void);
+
+void prompt_invalidate(void);   // the working directory changed (cd)
+
+// $PS2 (default "> "), before each further line of an unfinished command
+void print_continuation_prompt(void);
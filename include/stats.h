@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * Where the time of a command goes. Each phase keeps a count, total, max
+ * and a log-linear histogram of its durations (four buckets per power of
+ * two, so percentiles are within about 20%), printed by the stats builtin.
+ *
+ * Built with SHELL_STATS (make STATS=1, the default). Without it the
+ * STATS_BEGIN/STATS_END markers expand to nothing and no clock is read.
+ */
+typedef enum {
+    STAT_INPUT,     // reading a line (includes waiting at the prompt)
+    STAT_TOKENIZE,  // get_tokens
+    STAT_PARSE,     // parse_plan
+    STAT_EXPAND,    // expand_tokens
+    STAT_PATH,      // search_path
+    STAT_SPAWN,     // creating a process: launch(), fork for builtins/subshells
+    STAT_WAIT,      // waiting for a foreground job
+    STAT_PHASES
+} stat_phase;
+
+#ifdef SHELL_STATS
+
+static inline uint64_t stats_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+void stats_record(stat_phase phase, uint64_t ns);
+
+#define STATS_BEGIN(t) uint64_t t = stats_now()
+#define STATS_END(phase, t) stats_record((phase), stats_now() - (t))
+
+#else
+
+#define STATS_BEGIN(t) ((void)0)
+#define STATS_END(phase, t) ((void)0)
+
+#endif
+
+bool stats_enabled(void);
+void stats_print(bool histograms);  // stats [-v]
+void stats_reset(void);             // stats -r
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdbool.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+/**
+ * A "timeout [-s SIG] [-k KILL_AFTER] DURATION" prefix on a command.
+ * There is no timeout process: the shell arms a timerfd for the child
+ * and signals it through a pidfd when the timer fires.
+ */
+typedef struct {
+    int words;                      // argv words taken by the prefix
+    int signal;                     // sent after duration (default SIGTERM)
+    struct timespec duration;
+    struct timespec kill_after;     // then SIGKILL this much later (0: never)
+} timeout_spec;
+
+/**
+ * Parses a timeout prefix at the start of argv.
+ * Returns 1 and fills *spec if there is one, 0 if argv does not start
+ * with "timeout", or -1 (after printing the error) if it is malformed.
+ */
+int timeout_parse(char **argv, timeout_spec *spec);
+
+void timeout_arm(pid_t pid, const timeout_spec *spec);
+
+/**
+ * Readable when a timer has fired; timeout_dispatch() then signals the
+ * children concerned. The input loop polls it alongside the SIGCHLD fd.
+ */
+int timeout_fd(void);
+void timeout_dispatch(void);
+
+/**
+ * Disarms the timeout of a reaped child and returns its exit status
+ * ($?): 124 if it timed out (137 if it had to be killed), as timeout(1).
+ */
+int timeout_reaped(pid_t pid, int status);
+
+// Waits for a foreground child (collecting its usage) while still
+// firing every armed timeout
+int timeout_wait(pid_t pid, struct rusage *usage);
@@ -0,0 +1,22 @@
+#pragma once
+
+/**
+ * Utilities run in the shell itself instead of through search_path() and
+ * launch(). Output and exit status follow POSIX (and the GNU coreutils
+ * binaries where POSIX leaves a choice, e.g. echo -n/-e); diagnostics go
+ * to stderr, and a failed write makes the status 1.
+ */
+int echo_builtin(int argc, char **argv);
+int printf_builtin(int argc, char **argv);
+int test_builtin(int argc, char **argv);    // test and [
+int pwd_builtin(int argc, char **argv);
+
+// cat [-u] [FILE...], cp SRC... DEST and tee [-ai] [FILE...] move data
+// inside the kernel where they can (see copy.h); other options run the
+// real utility
+int cat_builtin(int argc, char **argv);
+int cp_builtin(int argc, char **argv);
+int tee_builtin(int argc, char **argv);
+
+// env [-i] [NAME=value]... [COMMAND [ARG...]]
+int env_builtin(int argc, char **argv);
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdbool.h>
+#include "lexer.h"
+
+/**
+ * Shell variables, in a hash table seeded from environ at startup.
+ * Lookups never walk environ, and setting one rebuilds nothing: children
+ * get the vars_environ() snapshot.
+ */
+void vars_init(void);
+const char *vars_get(const char *name);     // NULL if unset
+void vars_set(const char *name, const char *value, bool export);
+void vars_unset(const char *name);
+void vars_print_exported(void);             // export (no arguments)
+
+/**
+ * Bumped by every set and unset, so caches built from variables (PATH,
+ * the prompt) can skip re-checking them while it is unchanged.
+ */
+unsigned long vars_generation(void);
+
+/**
+ * The exported variables as an envp for execve() or posix_spawn().
+ * Rebuilt (and made the shell's environ) on the first call after an
+ * exported variable is set, exported or unset; otherwise the same array
+ * is returned. Valid until then.
+ */
+char **vars_environ(void);
+
+/**
+ * While a builtin runs as `NAME=value... builtin`, its envp (from
+ * vars_environ_with()) is returned by vars_environ() instead, so what
+ * the builtin launches, or prints as env, has the assignments.
+ * NULL ends it. Returns the override it replaces.
+ */
+char **vars_override_environ(char **envp);
+
+/**
+ * An envp for one command run as `NAME=value... cmd`: the n assignments
+ * replace or add to the exported variables (only those with empty, as
+ * env -i). Only the pointer array is new; the strings are the snapshot's
+ * and the assignments themselves. Caller frees the array.
+ */
+char **vars_environ_with(char *const *assignments, size_t n, bool empty);
+
+void vars_set_status(int status);           // the value of $?
+
+// NAME=value, with NAME a valid variable name
+bool is_assignment(const char *word);
+bool is_valid_name(const char *s);
+
+/**
+ * Expands ~ at the start of a word and $NAME, ${NAME}, $? and $$ anywhere
+ * in it, in one pass per word, and drops the lexer's CTLESC markers.
+ * Results are written back into the word when they fit, otherwise into
+ * the token list's arena.
+ */
+void expand_tokens(tokenlist *tokens);
+
+/**
+ * Whether word, an item of tokens after expand_tokens(), assigns a
+ * variable: it was written NAME=value with NAME= unquoted. A word that
+ * only reads that way after quote removal or expansion ('X=1', $A) is an
+ * ordinary word, e.g. a command name.
+ */
+bool is_assignment_word(const tokenlist *tokens, const char *word);
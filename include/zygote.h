@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include "launch.h"
+
+/**
+ * The "zygote" launcher: a helper forked from the shell while its image is
+ * still small, which forks and execs commands on the shell's behalf, so a
+ * launch never copies the page tables of a large shell.
+ *
+ * The shell sends the resolved path, argv, envp, the stdin/stdout/
+ * stderr fds and an fd for its working directory (SCM_RIGHTS) over a
+ * socketpair. The helper creates the child
+ * with clone3(CLONE_PARENT | CLONE_PIDFD), which makes it a child of the
+ * shell, not of the helper: waitpid(), SIGCHLD and job control work as
+ * for any other launcher. The child's pid and pidfd are sent back.
+ */
+bool zygote_start(void);            // no-op if it is already running
+bool zygote_running(void);
+
+/**
+ * Starts the described process through the helper.
+ * Returns its pid (and stores a pidfd for it in *pidfd, or -1), or -1 if
+ * the helper is not usable, in which case the caller should launch the
+ * process itself.
+ */
+pid_t zygote_launch(const launch_t *l, int *pidfd);
@@ -0,0 +1,511 @@
+#define _GNU_SOURCE
+
+#include "builtins.h"
+#include "path.h"
+#include "launch.h"
+#include "parallel.h"
+#include "prompt.h"
+#include "stats.h"
+#include "vars.h"
+#include "utilities.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Shared by the exit builtin and end of input
+void exit_shell(shell_t *sh)
+{
+    printf("Waiting for background processes to complete...\n");
+    wait_for_jobs(sh->jobs);
+
+    printf("Last valid commands:\n");
+    display_history(sh->history);
+}
+
+// exit [n]
+static int builtin_exit(shell_t *sh, int argc, char **argv)
+{
+    if (sh->interactive)
+        exit_shell(sh);
+    sh->should_exit = true;
+    return argc > 1 ? atoi(argv[1]) & 0xff : 0;
+}
+
+// cd [dir]
+static int builtin_cd(shell_t *sh, int argc, char **argv)
+{
+    (void)sh;
+    if (argc > 2) {
+        printf("cd: too many arguments\n");
+        return 1;
+    }
+
+    const char *target_dir = (argc == 2) ? argv[1] : vars_get("HOME");
+
+    if (target_dir == NULL) {
+        printf("cd: HOME not set\n");
+        return 1;
+    }
+
+    struct stat st;
+    if (stat(target_dir, &st) != 0) {
+        printf("cd: %s: No such file or directory\n", target_dir);
+        return 1;
+    }
+
+    if (!S_ISDIR(st.st_mode)) {
+        printf("cd: %s: Not a directory\n", target_dir);
+        return 1;
+    }
+
+    if (chdir(target_dir) != 0) {
+        perror("cd");
+        return 1;
+    }
+    prompt_invalidate();
+    return 0;
+}
+
+// hash [-r] [name...]
+static int builtin_hash(shell_t *sh, int argc, char **argv)
+{
+    (void)sh;
+    if (argc == 1) {
+        path_cache_print();
+        return 0;
+    }
+
+    int status = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0) {
+            path_cache_clear();
+            continue;
+        }
+        char *cmd_path = search_path(argv[i]);
+        if (cmd_path == NULL) {
+            printf("hash: %s: not found\n", argv[i]);
+            status = 1;
+        }
+        free(cmd_path);
+    }
+    return status;
+}
+
+// launcher [spawn | fork | zygote]: how external commands are started
+static int builtin_launcher(shell_t *sh, int argc, char **argv)
+{
+    (void)sh;
+    if (argc == 1) {
+        printf("%s\n", launch_mode_name());
+    } else if (!launch_set_mode(argv[1])) {
+        printf("launcher: %s: use spawn, fork or zygote\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
+
+// wait [-n] [%job | pid]...
+static int builtin_wait(shell_t *sh, int argc, char **argv)
+{
+    bool any = false;
+    int first = 1;
+    if (argc > 1 && strcmp(argv[1], "-n") == 0) {
+        any = true;
+        first = 2;
+    }
+
+    int status = 0;
+    int job_nums[argc];
+    int n = 0;
+    for (int i = first; i < argc; i++) {
+        const char *arg = argv[i];
+        job_t *job = (arg[0] == '%') ? find_job(sh->jobs, atoi(arg + 1))
+                                     : find_job_by_pid(sh->jobs, atoi(arg));
+        if (job == NULL) {
+            printf("wait: %s: no such job\n", arg);
+            status = 127;
+            continue;
+        }
+        job_nums[n++] = job->job_num;
+    }
+    if (n == 0 && argc > first)
+        return status;
+
+    return wait_jobs(sh->jobs, job_nums, n, any);
+}
+
+// export [NAME[=value]]...
+static int builtin_export(shell_t *sh, int argc, char **argv)
+{
+    (void)sh;
+    if (argc == 1)
+        vars_print_exported();
+
+    int status = 0;
+    for (int i = 1; i < argc; i++) {
+        char *name = argv[i];
+        char *eq = strchr(name, '=');
+        if (eq != NULL)
+            *eq = '\0';
+        if (is_valid_name(name)) {
+            vars_set(name, eq ? eq + 1 : NULL, true);
+        } else {
+            printf("export: `%s': not a valid identifier\n", name);
+            status = 1;
+        }
+        if (eq != NULL)
+            *eq = '=';
+    }
+    return status;
+}
+
+// unset NAME...
+static int builtin_unset(shell_t *sh, int argc, char **argv)
+{
+    (void)sh;
+    for (int i = 1; i < argc; i++)
+        vars_unset(argv[i]);
+    return 0;
+}
+
+// history [-s PATTERN]
+static int builtin_history(shell_t *sh, int argc, char **argv)
+{
+    if (argc == 1) {
+        history_print(sh->history, NULL);
+    } else if (argc == 3 && strcmp(argv[1], "-s") == 0) {
+        history_print(sh->history, argv[2]);
+    } else {
+        printf("history: usage: history [-s PATTERN]\n");
+        return 2;
+    }
+    return 0;
+}
+
+// stats [-v | -r]: where command time goes (see stats.h)
+static int builtin_stats(shell_t *sh, int argc, char **argv)
+{
+    (void)sh;
+    if (!stats_enabled()) {
+        printf("stats: built without instrumentation (make STATS=1)\n");
+        return 1;
+    }
+    if (argc == 1) {
+        stats_print(false);
+    } else if (argc == 2 && strcmp(argv[1], "-v") == 0) {
+        stats_print(true);
+    } else if (argc == 2 && strcmp(argv[1], "-r") == 0) {
+        stats_reset();
+    } else {
+        printf("stats: usage: stats [-v | -r]\n");
+        return 2;
+    }
+    return 0;
+}
+
+// parallel [-j N] cmd [arg...] [::: value...]
+/**
+ * Under `shell < script` (or `... | shell`) parallel's stdin is the
+ * script, and reading values from it would eat the commands after it. A
+ * terminal is fine: nothing is read ahead of the current line there.
+ */
+static bool stdin_is_shell_input(const shell_t *sh)
+{
+    struct stat st;
+    return sh->input_ino != 0 && fstat(STDIN_FILENO, &st) == 0 &&
+           st.st_dev == sh->input_dev && st.st_ino == sh->input_ino &&
+           !isatty(STDIN_FILENO);
+}
+
+static int builtin_parallel(shell_t *sh, int argc, char **argv)
+{
+    return parallel_builtin(argc, argv, sh->jobs, !stdin_is_shell_input(sh));
+}
+
+static int builtin_jobs(shell_t *sh, int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    if (sh->jobs->count == 0) {
+        printf("No active background processes.\n");
+        return 0;
+    }
+
+    for (job_t *job = sh->jobs->head; job != NULL; job = job->next) {
+        printf("[%d]+ %d %s\n", job->job_num, job->pid, job->command);
+    }
+    return 0;
+}
+
+/**
+ * Builtins either act on the shell or are plain utilities
+ * (utilities.c), which only see their arguments.
+ */
+typedef struct {
+    const char *name;
+    int (*shell_fn)(shell_t *sh, int argc, char **argv);
+    int (*util_fn)(int argc, char **argv);
+} builtin_def;
+
+static int util_compgen(int argc, char **argv);
+static int util_true(int argc, char **argv)  { (void)argc; (void)argv; return 0; }
+static int util_false(int argc, char **argv) { (void)argc; (void)argv; return 1; }
+
+static const builtin_def builtin_table[] = {
+    { "exit",     builtin_exit,     NULL },
+    { "cd",       builtin_cd,       NULL },
+    { "hash",     builtin_hash,     NULL },
+    { "launcher", builtin_launcher, NULL },
+    { "wait",     builtin_wait,     NULL },
+    { "export",   builtin_export,   NULL },
+    { "unset",    builtin_unset,    NULL },
+    { "history",  builtin_history,  NULL },
+    { "parallel", builtin_parallel, NULL },
+    { "jobs",     builtin_jobs,     NULL },
+    { "stats",    builtin_stats,    NULL },
+    { "compgen",  NULL, util_compgen },
+    { "echo",     NULL, echo_builtin },
+    { "printf",   NULL, printf_builtin },
+    { "test",     NULL, test_builtin },
+    { "[",        NULL, test_builtin },
+    { "true",     NULL, util_true },
+    { "false",    NULL, util_false },
+    { "pwd",      NULL, pwd_builtin },
+    { "cat",      NULL, cat_builtin },
+    { "cp",       NULL, cp_builtin },
+    { "tee",      NULL, tee_builtin },
+    { "env",      NULL, env_builtin },
+};
+
+#define NBUILTINS (sizeof(builtin_table) / sizeof(builtin_table[0]))
+#define BUILTIN_SLOTS 64        // power of two, well over NBUILTINS
+
+// Open-addressed index into builtin_table, filled on first lookup
+static const builtin_def *builtin_slots[BUILTIN_SLOTS];
+static bool builtins_indexed;
+
+static unsigned hash_name(const char *s)
+{
+    unsigned h = 2166136261u;   // FNV-1a
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static const builtin_def *find_builtin(const char *name)
+{
+    if (!builtins_indexed) {
+        builtins_indexed = true;
+        for (size_t i = 0; i < NBUILTINS; i++) {
+            unsigned slot = hash_name(builtin_table[i].name);
+            while (builtin_slots[slot & (BUILTIN_SLOTS - 1)] != NULL)
+                slot++;
+            builtin_slots[slot & (BUILTIN_SLOTS - 1)] = &builtin_table[i];
+        }
+    }
+
+    for (unsigned slot = hash_name(name); ; slot++) {
+        const builtin_def *b = builtin_slots[slot & (BUILTIN_SLOTS - 1)];
+        if (b == NULL || strcmp(b->name, name) == 0)
+            return b;
+    }
+}
+
+typedef struct {
+    char **names;
+    size_t count;
+    size_t cap;
+} name_list;
+
+static void add_name(const char *name, void *arg)
+{
+    name_list *list = arg;
+    if (list->count == list->cap) {
+        list->cap = list->cap ? list->cap * 2 : 64;
+        list->names = realloc(list->names, list->cap * sizeof(char *));
+    }
+    list->names[list->count++] = strdup(name);
+}
+
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// compgen -c [prefix]: the command names that complete prefix
+static int util_compgen(int argc, char **argv)
+{
+    if (argc < 2 || argc > 3 || strcmp(argv[1], "-c") != 0) {
+        fprintf(stderr, "compgen: usage: compgen -c [prefix]\n");
+        return 2;
+    }
+    const char *prefix = argc == 3 ? argv[2] : "";
+    size_t len = strlen(prefix);
+
+    name_list list = { 0 };
+    for (size_t i = 0; i < NBUILTINS; i++)
+        if (strncmp(builtin_table[i].name, prefix, len) == 0)
+            add_name(builtin_table[i].name, &list);
+    path_complete(prefix, add_name, &list);
+
+    if (list.count > 0)
+        qsort(list.names, list.count, sizeof(char *), compare_names);
+    for (size_t i = 0; i < list.count; i++) {
+        if (i == 0 || strcmp(list.names[i], list.names[i - 1]) != 0)
+            printf("%s\n", list.names[i]);
+    }
+    for (size_t i = 0; i < list.count; i++)
+        free(list.names[i]);
+    free(list.names);
+    return list.count > 0 ? 0 : 1;
+}
+
+bool is_builtin(const char *name)
+{
+    return name != NULL && (is_assignment(name) || find_builtin(name) != NULL);
+}
+
+/**
+ * Runs argv if it is a shell builtin.
+ * Returns false if it is not; otherwise stores its exit status in *status.
+ */
+static bool handle_builtin(shell_t *sh, int argc, char **argv, int *status)
+{
+    if (argc == 0) {
+        return false;
+    }
+
+    // NAME=value ... on its own sets shell variables
+    if (is_assignment(argv[0])) {
+        for (int i = 0; i < argc; i++)
+            if (!is_assignment(argv[i]))
+                return false;
+        for (int i = 0; i < argc; i++) {
+            char *eq = strchr(argv[i], '=');
+            *eq = '\0';
+            vars_set(argv[i], eq + 1, false);
+            *eq = '=';
+        }
+        *status = 0;
+        return true;
+    }
+
+    const builtin_def *b = find_builtin(argv[0]);
+    if (b == NULL)
+        return false;  // Not a built-in command
+    *status = b->shell_fn ? b->shell_fn(sh, argc, argv) : b->util_fn(argc, argv);
+    return true;
+}
+
+static int count_args(char **argv)
+{
+    int argc = 0;
+    while (argv[argc] != NULL)
+        argc++;
+    return argc;
+}
+
+/**
+ * Points target at fd, returning a close-on-exec copy of what target was
+ * (-1 if nothing needed saving, -2 if target was closed).
+ */
+static int swap_fd(int fd, int target)
+{
+    if (fd < 0 || fd == target)
+        return -1;
+    int saved = fcntl(target, F_DUPFD_CLOEXEC, 10);
+    if (saved < 0)
+        saved = -2;
+    dup2(fd, target);
+    return saved;
+}
+
+static void restore_fd(int saved, int target)
+{
+    if (saved == -1)
+        return;
+    if (saved == -2) {
+        close(target);
+        return;
+    }
+    dup2(saved, target);
+    close(saved);
+}
+
+bool run_builtin(shell_t *sh, char **argv, int in_fd, int out_fd, char **envp, int *status)
+{
+    int argc = count_args(argv);
+    if (!is_builtin(argv[0]))
+        return false;
+
+    // what is already buffered belongs to the old stdout
+    if (out_fd >= 0)
+        fflush(stdout);
+    int saved_in = swap_fd(in_fd, STDIN_FILENO);
+    int saved_out = swap_fd(out_fd, STDOUT_FILENO);
+
+    char **saved_envp = vars_override_environ(envp);
+    bool handled = handle_builtin(sh, argc, argv, status);
+    vars_override_environ(saved_envp);
+
+    if (out_fd >= 0)
+        fflush(stdout);
+    restore_fd(saved_out, STDOUT_FILENO);
+    restore_fd(saved_in, STDIN_FILENO);
+    return handled;
+}
+
+/**
+ * Closes what exec would: every close-on-exec descriptor above stderr.
+ * These are the shell's own (pipe ends meant for other stages, the
+ * script, event fds); a stage holding the read end of its own output
+ * pipe would never see EPIPE once the reader exits.
+ */
+static void close_cloexec_fds(void)
+{
+    DIR *dir = opendir("/proc/self/fd");
+    if (dir == NULL)
+        return;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        int fd = atoi(entry->d_name);
+        if (fd > STDERR_FILENO && fd != dirfd(dir) && (fcntl(fd, F_GETFD) & FD_CLOEXEC))
+            close(fd);
+    }
+    closedir(dir);
+}
+
+pid_t fork_builtin(shell_t *sh, char **argv, int in_fd, int out_fd, char **envp)
+{
+    // otherwise the child would print the parent's pending output again
+    fflush(stdout);
+    STATS_BEGIN(t);
+    pid_t pid = fork();
+    if (pid != 0) {
+        STATS_END(STAT_SPAWN, t);
+        if (pid < 0)
+            perror("fork");
+        return pid;
+    }
+
+    if (in_fd >= 0 && in_fd != STDIN_FILENO)
+        dup2(in_fd, STDIN_FILENO);
+    if (out_fd >= 0 && out_fd != STDOUT_FILENO)
+        dup2(out_fd, STDOUT_FILENO);
+    close_cloexec_fds();
+
+    // the child's exit is the stage's, not the shell's
+    sh->interactive = false;
+    vars_override_environ(envp);
+    int status = 127;
+    handle_builtin(sh, count_args(argv), argv, &status);
+    fflush(stdout);
+    _exit(status);
+}
@@ -0,0 +1,271 @@
+#define _GNU_SOURCE
+
+#include "copy.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+
+#define COPY_BUF   (1 << 20)
+#define SPLICE_MAX (1 << 30)    // per call; the kernel stops at what the pipe holds
+
+static char buf[COPY_BUF];
+
+static bool is_pipe(int fd)
+{
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+}
+
+// splice() writes to pipes and to regular files not opened O_APPEND
+static bool splice_target(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+        return false;
+    if (S_ISFIFO(st.st_mode))
+        return true;
+    int flags = fcntl(fd, F_GETFL);
+    return S_ISREG(st.st_mode) && flags >= 0 && !(flags & O_APPEND);
+}
+
+static bool write_all(int fd, const char *p, size_t n)
+{
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        p += w;
+        n -= w;
+    }
+    return true;
+}
+
+static copy_result copy_buffered(int in_fd, int out_fd)
+{
+    while (1) {
+        ssize_t n = read(in_fd, buf, sizeof(buf));
+        if (n == 0)
+            return COPY_OK;
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return COPY_READ_ERROR;
+        }
+        if (!write_all(out_fd, buf, n))
+            return COPY_WRITE_ERROR;
+    }
+}
+
+// One call of a zero-copy primitive, from and to the current offsets
+typedef ssize_t (*copy_step)(int in_fd, int out_fd);
+
+static ssize_t step_copy_file_range(int in_fd, int out_fd)
+{
+    return copy_file_range(in_fd, NULL, out_fd, NULL, SPLICE_MAX, 0);
+}
+
+static ssize_t step_sendfile(int in_fd, int out_fd)
+{
+    return sendfile(out_fd, in_fd, NULL, SPLICE_MAX);
+}
+
+static ssize_t step_splice(int in_fd, int out_fd)
+{
+    return splice(in_fd, NULL, out_fd, NULL, SPLICE_MAX, SPLICE_F_MOVE);
+}
+
+/**
+ * Repeats step until end of input and returns true, or returns false when
+ * it fails; the failed call moved nothing, so the next method carries on
+ * from the same offsets.
+ */
+static bool run_step(copy_step step, int in_fd, int out_fd)
+{
+    while (1) {
+        ssize_t n = step(in_fd, out_fd);
+        if (n == 0)
+            return true;
+        if (n < 0 && errno != EINTR)
+            return false;
+    }
+}
+
+copy_result copy_fd(int in_fd, int out_fd)
+{
+    struct stat in, out;
+    if (fstat(in_fd, &in) < 0 || fstat(out_fd, &out) < 0)
+        return copy_buffered(in_fd, out_fd);
+
+    // file to file: the filesystem may share extents instead of copying.
+    // Files reporting size 0 (/proc) are left to the other methods.
+    if (S_ISREG(in.st_mode) && in.st_size > 0 && S_ISREG(out.st_mode) &&
+        run_step(step_copy_file_range, in_fd, out_fd))
+        return COPY_OK;
+    // file to pipe or socket: straight from the page cache
+    if (S_ISREG(in.st_mode) && run_step(step_sendfile, in_fd, out_fd))
+        return COPY_OK;
+    if ((S_ISFIFO(in.st_mode) || S_ISFIFO(out.st_mode)) &&
+        run_step(step_splice, in_fd, out_fd))
+        return COPY_OK;
+    return copy_buffered(in_fd, out_fd);
+}
+
+static copy_result tee_buffered(int in_fd, tee_out *outs, int nouts)
+{
+    int live = 0;
+    for (int i = 0; i < nouts; i++)
+        live += outs[i].error == 0;
+
+    while (live > 0) {
+        ssize_t n = read(in_fd, buf, sizeof(buf));
+        if (n == 0)
+            break;
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return COPY_READ_ERROR;
+        }
+        for (int i = 0; i < nouts; i++) {
+            if (outs[i].error == 0 && !write_all(outs[i].fd, buf, n)) {
+                outs[i].error = errno;
+                live--;
+            }
+        }
+    }
+    return COPY_OK;
+}
+
+// Reads and drops n bytes (data meant for an output that failed)
+static bool discard(int fd, size_t n)
+{
+    while (n > 0) {
+        ssize_t r = read(fd, buf, n < sizeof(buf) ? n : sizeof(buf));
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return false;
+        n -= r;
+    }
+    return true;
+}
+
+// Splices n bytes from a pipe holding at least that much; returns how
+// many were left behind (0 on success, errno set otherwise)
+static size_t splice_exact(int in_fd, int out_fd, size_t n)
+{
+    while (n > 0) {
+        ssize_t m = splice(in_fd, NULL, out_fd, NULL, n, SPLICE_F_MOVE);
+        if (m < 0 && errno == EINTR)
+            continue;
+        if (m <= 0) {
+            if (m == 0)
+                errno = EIO;
+            break;
+        }
+        n -= m;
+    }
+    return n;
+}
+
+/**
+ * Each round tee()s what the input pipe holds into an empty scratch pipe
+ * of the same capacity and splices it to one output, once for every
+ * output but the last. The last output then splices the data out of the
+ * input itself, which consumes it.
+ */
+static copy_result tee_splice(int in_fd, tee_out *outs, int nouts)
+{
+    int scratch[2];
+    if (pipe2(scratch, O_CLOEXEC) < 0)
+        return tee_buffered(in_fd, outs, nouts);
+    int size = fcntl(in_fd, F_GETPIPE_SZ);
+    if (size < 0 || fcntl(scratch[1], F_SETPIPE_SZ, size) < size) {
+        close(scratch[0]);
+        close(scratch[1]);
+        return tee_buffered(in_fd, outs, nouts);
+    }
+
+    copy_result result = COPY_OK;
+    while (1) {
+        int live = 0;
+        int last = -1;
+        for (int i = 0; i < nouts; i++) {
+            if (outs[i].error == 0) {
+                live++;
+                last = i;
+            }
+        }
+        if (live == 0)
+            break;
+
+        ssize_t n;
+        if (live == 1) {
+            n = splice(in_fd, NULL, outs[last].fd, NULL, SPLICE_MAX, SPLICE_F_MOVE);
+        } else {
+            // blocks until there is input; nothing is consumed yet
+            n = tee(in_fd, scratch[1], size, 0);
+        }
+        if (n == 0)
+            break;
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            // nothing was moved: let the buffered path report or carry on
+            result = tee_buffered(in_fd, outs, nouts);
+            break;
+        }
+        if (live == 1)
+            continue;
+
+        bool teed = true;   // the scratch pipe holds the round's data
+        for (int i = 0; i < last; i++) {
+            if (outs[i].error != 0)
+                continue;
+            if (!teed) {
+                ssize_t m;
+                do
+                    m = tee(in_fd, scratch[1], n, 0);
+                while (m < 0 && errno == EINTR);
+                if (m != n) {
+                    result = COPY_READ_ERROR;
+                    goto done;
+                }
+            }
+            teed = false;
+            size_t left = splice_exact(scratch[0], outs[i].fd, n);
+            if (left > 0) {
+                outs[i].error = errno;
+                discard(scratch[0], left);
+            }
+        }
+
+        size_t left = splice_exact(in_fd, outs[last].fd, n);
+        if (left > 0) {
+            outs[last].error = errno;
+            if (!discard(in_fd, left)) {
+                result = COPY_READ_ERROR;
+                break;
+            }
+        }
+    }
+done:
+    close(scratch[0]);
+    close(scratch[1]);
+    return result;
+}
+
+copy_result tee_fds(int in_fd, tee_out *outs, int nouts)
+{
+    bool spliceable = is_pipe(in_fd);
+    for (int i = 0; i < nouts && spliceable; i++)
+        spliceable = splice_target(outs[i].fd);
+    if (spliceable)
+        return tee_splice(in_fd, outs, nouts);
+    return tee_buffered(in_fd, outs, nouts);
+}
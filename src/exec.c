@@ -0,0 +1,669 @@
+#define _GNU_SOURCE
+
+#include "exec.h"
+#include "path.h"
+#include "launch.h"
+#include "vars.h"
+#include "stats.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <time.h>
+
+static int lexer_for_redirection(tokenlist *tokens, char **in_file, char **out_file);
+
+/**
+ * Executes an external command through launch() (posix_spawn or fork).
+ * Redirections are opened here so the child only has to dup2 and exec.
+ * With a timeout prefix, the command starts after timeout->words tokens.
+ * envp is NULL for the exported variables (see launch_t).
+ * Returns the command's exit status (0 for background commands).
+ */
+int execute_command(char *cmd_path, tokenlist *tokens, const timeout_spec *timeout, bool background, job_list_t *jobs,char *in_file, char *out_file, char **envp) {
+    int in_fd = -1;
+    int out_fd = -1;
+    if (!i_o_redirection(in_file, out_file, &in_fd, &out_fd))
+        return 1;
+
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+
+    // add_token() keeps items NULL-terminated, so it doubles as argv
+    char **argv = tokens->items + (timeout ? timeout->words : 0);
+    fflush(stdout);
+    launch_t l = { cmd_path, argv, in_fd, out_fd, -1, envp };
+    pid_t pid = launch(&l);
+    if (pid > 0 && timeout)
+        timeout_arm(pid, timeout);
+
+    if (in_fd >= 0) close(in_fd);
+    if (out_fd >= 0) close(out_fd);
+
+    if (pid < 0) {
+        return 127;
+    }
+
+    {
+        // Parent process
+        // Build command string from tokens
+        char cmd_str[1024] = "";
+        for (size_t i = 0; i < tokens->size; i++) {
+            strncat(cmd_str, tokens->items[i], sizeof(cmd_str) - strlen(cmd_str) - 1);
+            if (i < tokens->size - 1) {
+                strncat(cmd_str, " ", sizeof(cmd_str) - strlen(cmd_str) - 1);
+            }
+        }
+
+        if (background) {
+            // Add to job list
+            job_t *job = add_job(jobs, &pid, 1, cmd_str);
+            job->started = started;
+            if (jobs->notify)
+                printf("[%d] %d\n", job->job_num, pid);
+        } else {
+            // Wait for child, collecting its resource usage
+            job_t *job = new_job(&pid, 1, cmd_str);
+            job->started = started;
+            job->timed = jobs->time_next;
+            int status = wait_foreground(job);
+            free_job(job);
+            return status;
+        }
+    }
+    return 0;
+}
+
+static int lexer_for_redirection(tokenlist *tokens, char **in_file, char **out_file)
+{
+    *in_file = NULL;
+    *out_file = NULL;
+
+        //Scan all tokens to find < or >
+    for (size_t i = 0; i < tokens->size; i++) {
+
+        if (is_operator(tokens->items[i], "<")) {//< found
+            if (i + 1 >= tokens->size) {
+                fprintf(stderr, " missing file name \n");
+                return 0;
+            }
+
+            *in_file = strdup(tokens->items[i + 1]); //copy file name
+
+            //fix token list (items belong to the list's arena)
+            for (size_t j = i; j + 2 < tokens->size; j++)
+                tokens->items[j] = tokens->items[j + 2];
+
+            tokens->size -= 2;
+            tokens->items[tokens->size] = NULL; 
+            i--; 
+        }
+
+        else if (is_operator(tokens->items[i], ">")) { //> found
+            if (i + 1 >= tokens->size) {
+                fprintf(stderr, " missing file name >\n");
+                return 0;
+            }
+
+            *out_file = strdup(tokens->items[i + 1]);
+
+            for (size_t j = i; j + 2 < tokens->size; j++)
+                tokens->items[j] = tokens->items[j + 2];
+
+            tokens->size -= 2;
+            tokens->items[tokens->size] = NULL;
+            i--;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * Opens the redirection targets in the parent (O_CLOEXEC, so only the
+ * dup2'd copies survive into the child).
+ * Returns 1 on success, 0 if a file could not be used.
+ */
+int i_o_redirection(char *in_file, char *out_file, int *in_fd, int *out_fd)
+{
+    *in_fd = -1;
+    *out_fd = -1;
+
+    if (in_file) {
+        struct stat file_input;
+
+        if (stat(in_file, &file_input) != 0) { //check if file exists and add it to structure
+            fprintf(stderr, "input file error\n");
+            return 0;
+        }
+
+        if (!S_ISREG(file_input.st_mode)) {
+            fprintf(stderr, " not a regular file\n");
+            return 0;
+        }
+
+        *in_fd = open(in_file, O_RDONLY | O_CLOEXEC);
+        if (*in_fd < 0) {
+            fprintf(stderr, "input file open failed\n");
+            return 0;
+        }
+    }
+
+    
+    if (out_file) {
+        *out_fd = open(out_file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+				 S_IRUSR | S_IWUSR);
+        if (*out_fd < 0) {
+            fprintf(stderr, "output file open failed\n");
+            if (*in_fd >= 0) close(*in_fd);
+            *in_fd = -1;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * Removes "< file" / "> file" pairs from a NULL-terminated argv slice in
+ * place. Unlike lexer_for_redirection() nothing is freed or copied: the
+ * file names stay owned by the token list.
+ * Returns 0 if a redirection is missing its file name.
+ */
+static int split_redirections(char **argv, char **in_file, char **out_file)
+{
+    *in_file = NULL;
+    *out_file = NULL;
+
+    size_t out = 0;
+    for (size_t i = 0; argv[i] != NULL; i++) {
+        bool is_in = is_operator(argv[i], "<");
+        bool is_out = is_operator(argv[i], ">");
+        if (!is_in && !is_out) {
+            argv[out++] = argv[i];
+            continue;
+        }
+        if (argv[i + 1] == NULL) {
+            fprintf(stderr, " missing file name %s\n", argv[i]);
+            return 0;
+        }
+        if (is_in)
+            *in_file = argv[i + 1];
+        else
+            *out_file = argv[i + 1];
+        i++;
+    }
+    argv[out] = NULL;
+    return 1;
+}
+
+/**
+ * $PIPESIZE: the capacity in bytes (K and M suffixes allowed) given to the
+ * pipes between pipeline stages with F_SETPIPE_SZ. Unset or 0 keeps the
+ * kernel default of 64K. Larger pipes let each stage move more per wakeup
+ * on big streams; the kernel rounds the size up to a power of two pages
+ * and caps unprivileged users at /proc/sys/fs/pipe-max-size.
+ */
+static int pipe_size(void)
+{
+    static bool loaded;
+    static unsigned long gen;
+    static int size;
+    if (loaded && gen == vars_generation())
+        return size;
+    loaded = true;
+    gen = vars_generation();
+    size = 0;
+
+    const char *value = vars_get("PIPESIZE");
+    if (value == NULL || *value == '\0')
+        return 0;
+    char *end;
+    long long n = strtoll(value, &end, 10);
+    int shift = 0;
+    if (*end == 'K' || *end == 'k') {
+        shift = 10;
+        end++;
+    } else if (*end == 'M' || *end == 'm') {
+        shift = 20;
+        end++;
+    }
+    // range-checked before scaling, so the shift cannot overflow
+    if (*end != '\0' || n < 0 || n > (INT_MAX >> shift)) {
+        fprintf(stderr, "PIPESIZE: invalid size '%s'\n", value);
+        return 0;
+    }
+    size = (int)(n << shift);
+    return size;
+}
+
+/**
+ * Leading NAME=value words before a command are its environment, not
+ * shell variables. Returns how many words argv (items of tokens) starts
+ * with and stores the command's envp in *envp (free it), or returns 0
+ * with *envp NULL if there are none or nothing follows them (a plain
+ * assignment). A builtin gets them as the environment of what it starts
+ * (env, or the utility it falls back to), not as shell variables.
+ */
+static size_t take_assignments(const tokenlist *tokens, char **argv, char ***envp)
+{
+    size_t n = 0;
+    while (argv[n] != NULL && is_assignment_word(tokens, argv[n]))
+        n++;
+    if (n == 0 || argv[n] == NULL) {
+        *envp = NULL;
+        return 0;
+    }
+    *envp = vars_environ_with(argv, n, false);
+    return n;
+}
+
+/**
+ * A builtin, or the first of the NAME=value words that make up a plain
+ * assignment. A quoted or expanded word that reads NAME=value is neither:
+ * it names an external command.
+ */
+static bool runs_in_shell(const tokenlist *tokens, const char *word)
+{
+    if (word == NULL)
+        return false;
+    if (is_assignment(word))
+        return is_assignment_word(tokens, word);
+    return is_builtin(word);
+}
+
+/**
+ * Runs an N-stage pipeline. Stages are launched left to right; each pipe
+ * is created just before the stage that writes it and both ends are
+ * closed in the parent as soon as the stages on either side have them,
+ * so at most three pipe fds are open regardless of the pipeline length.
+ *
+ * A builtin in the last stage of a foreground pipeline runs in the shell
+ * itself once the other stages are started; builtins elsewhere are forked,
+ * since they have to run concurrently with their neighbours.
+ */
+int pipeline(tokenlist *tokens, int pipe_count, bool background, shell_t *sh) {
+    job_list_t *jobs = sh->jobs;
+    int cmd_count = pipe_count + 1;
+
+    // One argv buffer for every stage: the token pointers with each '|'
+    // replaced by the terminating NULL of the stage before it
+    char **argv_buf = malloc((tokens->size + 1) * sizeof(char *));
+    char **stage_argv[cmd_count];
+    int cmd_index = 0;
+    stage_argv[0] = argv_buf;
+    for (size_t i = 0; i < tokens->size; i++) {
+        if (is_operator(tokens->items[i], "|")) {
+            argv_buf[i] = NULL;
+            stage_argv[++cmd_index] = &argv_buf[i + 1];
+        } else {
+            argv_buf[i] = tokens->items[i];
+        }
+    }
+    argv_buf[tokens->size] = NULL;
+
+    char *in_files[cmd_count];
+    char *out_files[cmd_count];
+    for (int i = 0; i < cmd_count; i++) {
+        if (stage_argv[i][0] == NULL) {
+            fprintf(stderr, "syntax error near unexpected token `|'\n");
+            free(argv_buf);
+            return 2;
+        }
+        if (!split_redirections(stage_argv[i], &in_files[i], &out_files[i])) {
+            free(argv_buf);
+            return 2;
+        }
+        // only redirections: nothing to run
+        if (stage_argv[i][0] == NULL) {
+            fprintf(stderr, "syntax error near unexpected token `%s'\n",
+                    i < cmd_count - 1 ? "|" : "newline");
+            free(argv_buf);
+            return 2;
+        }
+    }
+
+    pid_t *pids = malloc(cmd_count * sizeof(pid_t));
+    int builtin_status = -1;  // a last stage run in the shell (pid 0)
+    int prev_read = -1;   // read end of the pipe feeding this stage
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    fflush(stdout);     // builtin output so far comes before the stages'
+    int capacity = pipe_size();
+
+    for (int i = 0; i < cmd_count; i++) {
+        int next[2] = { -1, -1 };
+        if (i < pipe_count && pipe2(next, O_CLOEXEC) < 0) {
+            perror("pipe");
+            cmd_count = i;
+            break;
+        }
+        // best effort: a refused size leaves the default pipe
+        if (next[1] >= 0 && capacity > 0)
+            fcntl(next[1], F_SETPIPE_SZ, capacity);
+
+        // any stage may carry its own timeout prefix
+        char **envp;
+        char **words = stage_argv[i] + take_assignments(tokens, stage_argv[i], &envp);
+        timeout_spec timeout;
+        int timed = timeout_parse(words, &timeout);
+        char **argv = words + (timed > 0 ? timeout.words : 0);
+
+        // resolve in the parent so the path cache is shared by every stage
+        bool builtin = timed == 0 && runs_in_shell(tokens, argv[0]);
+        char *cmd_path = (timed < 0 || builtin) ? NULL : search_path(argv[0]);
+        pids[i] = -1;
+
+        int in_fd = -1;
+        int out_fd = -1;
+        if (cmd_path == NULL && !builtin) {
+            if (timed >= 0)
+                printf("%s: command not found\n", argv[0]);
+        } else if (i_o_redirection(in_files[i], out_files[i], &in_fd, &out_fd)) {
+            // an explicit redirection wins over the pipe, as in sh
+            int stage_in = in_fd >= 0 ? in_fd : prev_read;
+            int stage_out = out_fd >= 0 ? out_fd : next[1];
+            if (builtin && i == cmd_count - 1 && !background) {
+                pids[i] = 0;
+                if (!run_builtin(sh, argv, stage_in, stage_out, envp, &builtin_status))
+                    builtin_status = 127;
+            } else if (builtin) {
+                pids[i] = fork_builtin(sh, argv, stage_in, stage_out, envp);
+            } else {
+                launch_t l = { cmd_path, argv, stage_in, stage_out, -1, envp };
+                pids[i] = launch(&l);
+                if (pids[i] > 0 && timed > 0)
+                    timeout_arm(pids[i], &timeout);
+            }
+        }
+
+        if (in_fd >= 0) close(in_fd);
+        if (out_fd >= 0) close(out_fd);
+        if (prev_read >= 0) close(prev_read);
+        if (next[1] >= 0) close(next[1]);
+        prev_read = next[0];
+        free(cmd_path);
+        free(envp);
+    }
+    if (prev_read >= 0) close(prev_read);
+    free(argv_buf);
+
+    // the pipeline's status is that of its last stage
+    int last_status = 127;
+    bool last_started = cmd_count > 0 && pids[cmd_count - 1] > 0;
+
+    // the job owns every stage that started, so none is left a zombie
+    int launched = 0;
+    for (int i = 0; i < cmd_count; i++)
+        if (pids[i] > 0)
+            pids[launched++] = pids[i];
+
+    char cmd_str[1024] = "";
+    for (size_t i = 0; i < tokens->size; i++) {
+        strncat(cmd_str, tokens->items[i], sizeof(cmd_str) - strlen(cmd_str) - 1);
+        if (i < tokens->size - 1) {
+            strncat(cmd_str, " ", sizeof(cmd_str) - strlen(cmd_str) - 1);
+        }
+    }
+
+    if (!background && launched > 0) {
+        // a job of its own, so every stage's usage is collected
+        job_t *job = new_job(pids, launched, cmd_str);
+        job->started = started;
+        job->timed = jobs->time_next;
+        int status = wait_foreground(job);
+        if (last_started)
+            last_status = status;
+        free_job(job);
+    } else if (background && last_started) {
+        job_t *job = add_job(jobs, pids, launched, cmd_str);
+        job->started = started;
+        if (jobs->notify)
+            printf("[%d] %d\n", job->job_num, job->pid);
+        last_status = 0;
+    }
+    if (builtin_status >= 0)
+        last_status = builtin_status;
+    free(pids);
+    return last_status;
+}
+
+// words joined by spaces, for job listings (newlines only matter to the parser)
+static void join_words(char *const *words, size_t n, char *buf, size_t size) {
+    buf[0] = '\0';
+    for (size_t i = 0; i < n; i++) {
+        if (is_operator(words[i], "\n"))
+            continue;
+        if (buf[0] != '\0')
+            strncat(buf, " ", size - strlen(buf) - 1);
+        strncat(buf, words[i], size - strlen(buf) - 1);
+    }
+}
+
+/**
+ * A command without pipes: a builtin (run in the shell, with any
+ * redirections swapped in for its duration) or an external command.
+ */
+static int run_simple(shell_t *sh, tokenlist *tokens, bool background) {
+    char *in_file = NULL;
+    char *out_file = NULL;
+    int status = 0;
+
+    //preventing memory leaks if < or > used withouth file name
+    bool redirected = lexer_for_redirection(tokens, &in_file, &out_file) != 0;
+
+    // after the redirections are out, which may come first (> f X=1 cmd)
+    char **envp = NULL;
+    size_t assigns = redirected ? take_assignments(tokens, tokens->items, &envp) : 0;
+    if (assigns > 0) {
+        // envp points at the words, which stay in the token arena
+        tokens->size -= assigns;
+        memmove(tokens->items, tokens->items + assigns, (tokens->size + 1) * sizeof(char *));
+    }
+
+    if (!redirected) {
+        status = 2;
+    } else if (tokens->size > 0 && runs_in_shell(tokens, tokens->items[0])) {
+        int in_fd, out_fd;
+        if (!i_o_redirection(in_file, out_file, &in_fd, &out_fd)) {
+            status = 1;
+        } else if (background) {
+            pid_t pid = fork_builtin(sh, tokens->items, in_fd, out_fd, envp);
+            if (pid > 0) {
+                char cmd_str[1024];
+                join_words(tokens->items, tokens->size, cmd_str, sizeof(cmd_str));
+                job_t *job = add_job(sh->jobs, &pid, 1, cmd_str);
+                if (sh->jobs->notify)
+                    printf("[%d] %d\n", job->job_num, pid);
+                sh->found_command = true;
+            }
+            status = pid > 0 ? 0 : 1;
+        } else if (run_builtin(sh, tokens->items, in_fd, out_fd, envp, &status)) {
+            sh->found_command = true;
+        } else {
+            printf("%s: command not found\n", tokens->items[0]);
+            status = 127;
+        }
+        if (in_fd >= 0) close(in_fd);
+        if (out_fd >= 0) close(out_fd);
+    } else if (tokens->size > 0) {
+        timeout_spec timeout;
+        int timed = timeout_parse(tokens->items, &timeout);
+        char *cmd = tokens->items[timed > 0 ? timeout.words : 0];
+        char *cmd_path = timed < 0 ? NULL : search_path(cmd);
+        if (cmd_path != NULL) {
+            sh->found_command = true;
+            status = execute_command(cmd_path, tokens, timed > 0 ? &timeout : NULL,
+                                     background, sh->jobs, in_file, out_file, envp);
+            free(cmd_path);
+        } else if (timed < 0) {
+            status = 125;  // timeout's own usage errors, as timeout(1)
+        } else {
+            printf("%s: command not found\n", cmd);
+            status = 127;
+        }
+    }
+
+    free(in_file);
+    free(out_file);
+    free(envp);
+    return status;
+}
+
+/**
+ * Runs a PIPELINE node. Its words are copied out of the line and expanded
+ * on every run, so a loop body sees each iteration's variables.
+ */
+static int run_pipeline(shell_t *sh, const plan_t *plan, const plan_node *node, int status) {
+    char *words[node->count + 1];
+    size_t n = 0;
+    int pipe_count = 0;
+    for (size_t i = node->first; i < node->first + node->count; i++) {
+        if (is_operator(plan->words[i], "\n"))
+            continue;  // after a |, only there for the parser
+        pipe_count += is_operator(plan->words[i], "|");
+        words[n++] = plan->words[i];
+    }
+
+    tokenlist *tokens = copy_tokens(words, n);
+    vars_set_status(status);
+    expand_tokens(tokens);
+    sh->jobs->time_next = node->timed;
+
+    if (pipe_count > 0) {
+        sh->found_command = true;
+        status = pipeline(tokens, pipe_count, node->background, sh);
+    } else {
+        status = run_simple(sh, tokens, node->background);
+    }
+    free_tokens(tokens);
+    return node->negate ? !status : status;
+}
+
+/**
+ * Runs a SUBSHELL node's body in a forked copy of the shell, so variable
+ * changes and cd stay inside it. Its redirections apply to the whole body.
+ */
+static int run_subshell(shell_t *sh, plan_t *plan, const plan_node *node, int status) {
+    tokenlist *redirs = copy_tokens(plan->words + node->first, node->count);
+    vars_set_status(status);
+    expand_tokens(redirs);
+    char *in_file, *out_file;
+    int in_fd = -1, out_fd = -1;
+    split_redirections(redirs->items, &in_file, &out_file);
+    if (!i_o_redirection(in_file, out_file, &in_fd, &out_fd)) {
+        free_tokens(redirs);
+        return 1;
+    }
+    free_tokens(redirs);
+
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    fflush(stdout);
+    STATS_BEGIN(t);
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (in_fd >= 0) dup2(in_fd, STDIN_FILENO);
+        if (out_fd >= 0) dup2(out_fd, STDOUT_FILENO);
+        // the parent's jobs are not this shell's children
+        *sh->jobs = (job_list_t){ .next_job_num = 1 };
+        sh->interactive = false;
+        status = run_plan(sh, plan, node - plan->nodes + 1, node->target, status);
+        fflush(stdout);
+        _exit(status);
+    }
+    STATS_END(STAT_SPAWN, t);
+    if (in_fd >= 0) close(in_fd);
+    if (out_fd >= 0) close(out_fd);
+    if (pid < 0) {
+        perror("fork");
+        return 1;
+    }
+    sh->found_command = true;
+
+    char cmd_str[1024];
+    join_words(plan->words + node->source, node->first + node->count - node->source,
+               cmd_str, sizeof(cmd_str));
+    if (node->background) {
+        job_t *job = add_job(sh->jobs, &pid, 1, cmd_str);
+        job->started = started;
+        if (sh->jobs->notify)
+            printf("[%d] %d\n", job->job_num, pid);
+        return 0;
+    }
+    job_t *job = new_job(&pid, 1, cmd_str);
+    job->started = started;
+    job->timed = node->timed;
+    status = wait_foreground(job);
+    free_job(job);
+    return node->negate ? !status : status;
+}
+
+/**
+ * Executes plan nodes [pc, end), starting with $? = status. Returns the
+ * status of the last command run.
+ */
+int run_plan(shell_t *sh, plan_t *plan, size_t pc, size_t end, int status) {
+    while (pc < end && !sh->should_exit) {
+        plan_node *node = &plan->nodes[pc++];
+        switch (node->op) {
+        case PLAN_PIPELINE:
+            status = run_pipeline(sh, plan, node, status);
+            break;
+        case PLAN_JUMP:
+            pc = node->target;
+            break;
+        case PLAN_AND:
+            if (status != 0)
+                pc = node->target;
+            break;
+        case PLAN_OR:
+            if (status == 0)
+                pc = node->target;
+            break;
+        case PLAN_BRANCH:
+            if ((status == 0) == node->negate) {
+                status = node->saved;
+                pc = node->target;
+            }
+            break;
+        case PLAN_LOOP: {
+            plan_node *test = &plan->nodes[node->target];
+            test->saved = 0;
+            if (test->values != NULL) {
+                free_tokens(test->values);
+                test->values = NULL;
+            }
+            break;
+        }
+        case PLAN_SAVE:
+            plan->nodes[node->target].saved = status;
+            break;
+        case PLAN_FOR:
+            if (node->values == NULL) {
+                node->values = copy_tokens(plan->words + node->first, node->count);
+                vars_set_status(status);
+                expand_tokens(node->values);
+                node->next_value = 0;
+            }
+            if (node->next_value < node->values->size) {
+                vars_set(node->name, node->values->items[node->next_value++], false);
+            } else {
+                free_tokens(node->values);
+                node->values = NULL;
+                status = node->saved;
+                pc = node->target;
+            }
+            break;
+        case PLAN_SUBSHELL:
+            status = run_subshell(sh, plan, node, status);
+            pc = node->target;
+            break;
+        }
+    }
+    return status;
+}
@@ -0,0 +1,468 @@
+#include "history.h"
+#include "vars.h"
+
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define HIST_MAGIC 0x31747369686c6873ULL    // "shlhist1"
+#define HIST_AVG_LINE 64                    // text ring bytes per slot
+#define HIST_SENTINEL '\002'                // two start every indexed entry
+
+struct hist_header {
+    uint64_t magic;
+    uint64_t nslots;                // index ring size (HISTSIZE)
+    uint64_t text_size;             // text ring size in bytes
+    _Atomic uint64_t next_seq;      // sequence numbers handed out
+    _Atomic uint64_t text_tail;     // text bytes handed out (never wraps)
+    char pad[24];                   // keep the slots cache-line aligned
+};
+
+struct hist_slot {
+    _Atomic uint64_t seq;           // seq + 1 once published, 0 while written
+    _Atomic uint64_t offset;        // text position, as text_tail counts it
+    _Atomic uint32_t len;
+    _Atomic uint32_t pid;           // the session that wrote it
+};
+
+typedef struct {
+    uint32_t key;                   // trigram + 1; 0 marks an empty bucket
+    uint32_t n;
+    uint32_t cap;
+    uint32_t *ids;                  // entry seq - index base, ascending
+} posting;
+
+struct hist_index {
+    uint64_t base;                  // seq of id 0
+    uint64_t end;                   // entries before end are indexed
+    posting *table;                 // open addressing, keyed by trigram
+    size_t size;                    // buckets (power of two)
+    size_t used;
+};
+
+static ssize_t read_entry(const command_history_t *h, uint64_t seq, char *buf, size_t size,
+                          pid_t *pid);
+static void index_catch_up(command_history_t *h);
+
+static size_t layout_size(uint64_t nslots, uint64_t text_size)
+{
+    return sizeof(struct hist_header) + nslots * sizeof(struct hist_slot) + text_size;
+}
+
+/**
+ * Points h into a mapping of nslots slots. A new mapping (init) gets its
+ * header written; an existing one already has it.
+ */
+static bool map_history(command_history_t *h, void *base, uint64_t nslots, uint64_t text_size,
+                        bool init)
+{
+    if (base == MAP_FAILED)
+        return false;
+    h->hdr = base;
+    h->slots = (struct hist_slot *)(h->hdr + 1);
+    h->text = (char *)(h->slots + nslots);
+    h->map_size = layout_size(nslots, text_size);
+
+    if (init) {
+        h->hdr->nslots = nslots;
+        h->hdr->text_size = text_size;
+        atomic_store(&h->hdr->next_seq, 0);
+        atomic_store(&h->hdr->text_tail, 0);
+        h->hdr->magic = HIST_MAGIC;
+    }
+    return true;
+}
+
+static bool open_file(command_history_t *h, uint64_t nslots, uint64_t text_size)
+{
+    char path[4096];
+    const char *histfile = vars_get("HISTFILE");
+    const char *home = vars_get("HOME");
+    if (histfile != NULL && histfile[0] != '\0')
+        snprintf(path, sizeof(path), "%s", histfile);
+    else if (home != NULL)
+        snprintf(path, sizeof(path), "%s/.shell_history", home);
+    else
+        return false;
+
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd < 0)
+        return false;
+
+    // The lock only covers creating the file; appends never take it
+    flock(fd, LOCK_EX);
+    bool ok = false;
+    struct stat st;
+    struct hist_header hdr;
+    if (fstat(fd, &st) == 0 && st.st_size == 0) {
+        size_t size = layout_size(nslots, text_size);
+        ok = ftruncate(fd, size) == 0 &&
+             map_history(h, mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0),
+                         nslots, text_size, true);
+    } else if (pread(fd, &hdr, sizeof(hdr), 0) == (ssize_t)sizeof(hdr) &&
+               hdr.magic == HIST_MAGIC && hdr.nslots > 0 &&
+               (off_t)layout_size(hdr.nslots, hdr.text_size) == st.st_size) {
+        // An existing file keeps the depth it was created with
+        ok = map_history(h, mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0),
+                         hdr.nslots, hdr.text_size, false);
+    }
+    flock(fd, LOCK_UN);
+    close(fd);
+    return ok;
+}
+
+void history_open(command_history_t *h, bool persistent)
+{
+    const char *histsize = vars_get("HISTSIZE");
+    long nslots = histsize ? atol(histsize) : HISTSIZE_DEFAULT;
+    if (nslots < 3)
+        nslots = 3;
+    uint64_t text_size = (uint64_t)nslots * HIST_AVG_LINE;
+    if (text_size < 2 * HIST_MAX_LINE)
+        text_size = 2 * HIST_MAX_LINE;
+
+    if (!persistent || !open_file(h, nslots, text_size)) {
+        size_t size = layout_size(nslots, text_size);
+        if (!map_history(h, mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_ANONYMOUS, -1, 0), nslots, text_size, true)) {
+            perror("history: mmap");
+            exit(1);
+        }
+    }
+
+    h->session_start = atomic_load(&h->hdr->next_seq);
+    h->pid = getpid();
+    h->index = NULL;
+}
+
+static void free_index(struct hist_index *idx)
+{
+    if (idx == NULL)
+        return;
+    for (size_t i = 0; i < idx->size; i++)
+        free(idx->table[i].ids);
+    free(idx->table);
+    free(idx);
+}
+
+void history_close(command_history_t *h)
+{
+    free_index(h->index);
+    h->index = NULL;
+    munmap(h->hdr, h->map_size);
+    h->hdr = NULL;
+}
+
+uint64_t history_end(const command_history_t *h)
+{
+    return atomic_load_explicit(&h->hdr->next_seq, memory_order_acquire);
+}
+
+uint64_t history_capacity(const command_history_t *h)
+{
+    return h->hdr->nslots;
+}
+
+void add_to_history(command_history_t *h, const char *cmd)
+{
+    size_t len = strnlen(cmd, HIST_MAX_LINE - 1);
+    if (len == 0)
+        return;
+
+    uint64_t text_size = h->hdr->text_size;
+    uint64_t seq = atomic_fetch_add(&h->hdr->next_seq, 1);
+    uint64_t off = atomic_fetch_add(&h->hdr->text_tail, len);
+
+    // Readers of the entry this slot held see it vanish before it changes
+    struct hist_slot *slot = &h->slots[seq % h->hdr->nslots];
+    atomic_store_explicit(&slot->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    size_t at = off % text_size;
+    size_t first = len < text_size - at ? len : text_size - at;
+    memcpy(h->text + at, cmd, first);
+    memcpy(h->text, cmd + first, len - first);
+
+    atomic_store_explicit(&slot->offset, off, memory_order_relaxed);
+    atomic_store_explicit(&slot->len, (uint32_t)len, memory_order_relaxed);
+    atomic_store_explicit(&slot->pid, (uint32_t)h->pid, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_release);
+
+    // Once someone has searched, keep the index current
+    if (h->index != NULL)
+        index_catch_up(h);
+}
+
+static ssize_t read_entry(const command_history_t *h, uint64_t seq, char *buf, size_t size,
+                          pid_t *pid)
+{
+    const struct hist_slot *slot = &h->slots[seq % h->hdr->nslots];
+    if (atomic_load_explicit(&slot->seq, memory_order_acquire) != seq + 1)
+        return -1;
+
+    uint64_t text_size = h->hdr->text_size;
+    uint64_t off = atomic_load_explicit(&slot->offset, memory_order_relaxed);
+    size_t len = atomic_load_explicit(&slot->len, memory_order_relaxed);
+    if (pid != NULL)
+        *pid = atomic_load_explicit(&slot->pid, memory_order_relaxed);
+    if (len > size - 1)
+        len = size - 1;
+
+    size_t at = off % text_size;
+    size_t first = len < text_size - at ? len : text_size - at;
+    memcpy(buf, h->text + at, first);
+    memcpy(buf + first, h->text, len - first);
+    buf[len] = '\0';
+
+    // Valid only if the slot was not reused and no later append has
+    // wrapped the text ring over these bytes meanwhile
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq + 1 ||
+        atomic_load_explicit(&h->hdr->text_tail, memory_order_relaxed) - off > text_size)
+        return -1;
+    return len;
+}
+
+ssize_t history_get(const command_history_t *h, uint64_t seq, char *buf, size_t size)
+{
+    return read_entry(h, seq, buf, size, NULL);
+}
+
+void display_history(command_history_t *h) {
+    // Other sessions' entries are interleaved; pick out the last 3 of ours
+    static char lines[3][HIST_MAX_LINE];
+    int count = 0;
+    uint64_t end = history_end(h);
+    uint64_t oldest = end > h->hdr->nslots ? end - h->hdr->nslots : 0;
+    if (oldest < h->session_start)
+        oldest = h->session_start;
+
+    for (uint64_t seq = end; seq > oldest && count < 3; seq--) {
+        pid_t pid;
+        if (read_entry(h, seq - 1, lines[2 - count], HIST_MAX_LINE, &pid) >= 0 && pid == h->pid)
+            count++;
+    }
+
+    if (count == 0) {
+        printf("No commands in history.\n");
+        return;
+    }
+
+    for (int i = 3 - count; i < 3; i++) {
+        printf("\t%s\n", lines[i]);
+    }
+}
+
+static uint64_t oldest_entry(const command_history_t *h, uint64_t end)
+{
+    return end > h->hdr->nslots ? end - h->hdr->nslots : 0;
+}
+
+static uint32_t trigram(const unsigned char *p)
+{
+    return ((uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2]) + 1;
+}
+
+static posting *lookup(struct hist_index *idx, uint32_t key, bool insert)
+{
+    if (insert && (idx->used + 1) * 2 > idx->size) {
+        struct hist_index old = *idx;
+        idx->size *= 2;
+        idx->table = calloc(idx->size, sizeof(posting));
+        for (size_t i = 0; i < old.size; i++) {
+            if (old.table[i].key == 0)
+                continue;
+            size_t j = (old.table[i].key * 2654435761u) & (idx->size - 1);
+            while (idx->table[j].key != 0)
+                j = (j + 1) & (idx->size - 1);
+            idx->table[j] = old.table[i];
+        }
+        free(old.table);
+    }
+
+    size_t i = (key * 2654435761u) & (idx->size - 1);
+    while (idx->table[i].key != 0) {
+        if (idx->table[i].key == key)
+            return &idx->table[i];
+        i = (i + 1) & (idx->size - 1);
+    }
+    if (!insert)
+        return NULL;
+    idx->table[i].key = key;
+    idx->used++;
+    return &idx->table[i];
+}
+
+static void index_entry(struct hist_index *idx, uint32_t id, const char *text)
+{
+    unsigned char grams[HIST_MAX_LINE + 2] = { HIST_SENTINEL, HIST_SENTINEL };
+    size_t len = strlen(text);
+    memcpy(grams + 2, text, len);
+
+    for (size_t i = 0; i + 3 <= len + 2; i++) {
+        posting *p = lookup(idx, trigram(grams + i), true);
+        if (p->n > 0 && p->ids[p->n - 1] == id)
+            continue;   // repeated trigram in the same entry
+        if (p->n == p->cap) {
+            p->cap = p->cap ? p->cap * 2 : 4;
+            p->ids = realloc(p->ids, p->cap * sizeof(uint32_t));
+        }
+        p->ids[p->n++] = id;
+    }
+}
+
+// Indexes the entries appended (by any session) since the last call
+static void index_catch_up(command_history_t *h)
+{
+    uint64_t end = history_end(h);
+    uint64_t oldest = oldest_entry(h, end);
+
+    // Start over once the ring has been overwritten more than once since
+    // the index was built; until then stale ids just fail to read
+    if (h->index != NULL && oldest - h->index->base > h->hdr->nslots) {
+        free_index(h->index);
+        h->index = NULL;
+    }
+    if (h->index == NULL) {
+        h->index = calloc(1, sizeof(struct hist_index));
+        h->index->size = 1024;
+        h->index->table = calloc(h->index->size, sizeof(posting));
+        h->index->base = h->index->end = oldest;
+    }
+
+    struct hist_index *idx = h->index;
+    char buf[HIST_MAX_LINE];
+    for (uint64_t seq = idx->end > oldest ? idx->end : oldest; seq < end; seq++)
+        if (read_entry(h, seq, buf, sizeof(buf), NULL) >= 0)
+            index_entry(idx, (uint32_t)(seq - idx->base), buf);
+    idx->end = end;
+}
+
+static bool contains(const posting *p, uint32_t id)
+{
+    size_t lo = 0, hi = p->n;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (p->ids[mid] < id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < p->n && p->ids[lo] == id;
+}
+
+static bool matches(const char *text, const char *pattern, bool prefix)
+{
+    return prefix ? strncmp(text, pattern, strlen(pattern)) == 0 : strstr(text, pattern) != NULL;
+}
+
+typedef bool (*visit_fn)(uint64_t seq, const char *text, void *arg);
+
+/**
+ * Calls visit for each entry containing (or, with prefix, starting with)
+ * pattern, oldest first or newest first, until visit returns false.
+ * Candidates are the intersection of the pattern's trigram postings,
+ * driven by the shortest list; each is then checked against the text.
+ */
+static void search(command_history_t *h, const char *pattern, bool prefix, bool newest_first,
+                   visit_fn visit, void *arg)
+{
+    index_catch_up(h);
+    struct hist_index *idx = h->index;
+    uint64_t oldest = oldest_entry(h, idx->end);
+    char buf[HIST_MAX_LINE];
+
+    unsigned char query[HIST_MAX_LINE + 2] = { HIST_SENTINEL, HIST_SENTINEL };
+    size_t start = prefix ? 0 : 2;
+    size_t plen = strnlen(pattern, HIST_MAX_LINE - 1);
+    memcpy(query + 2, pattern, plen);
+    size_t ngrams = plen + 2 - start >= 3 ? plen + 2 - start - 2 : 0;
+
+    if (ngrams == 0) {
+        // Shorter than a trigram: every entry is a candidate
+        for (uint64_t i = 0; i < idx->end - oldest; i++) {
+            uint64_t seq = newest_first ? idx->end - 1 - i : oldest + i;
+            if (read_entry(h, seq, buf, sizeof(buf), NULL) >= 0 && matches(buf, pattern, prefix) &&
+                !visit(seq, buf, arg))
+                return;
+        }
+        return;
+    }
+
+    const posting *lists[ngrams];
+    size_t shortest = 0;
+    for (size_t g = 0; g < ngrams; g++) {
+        lists[g] = lookup(idx, trigram(query + start + g), false);
+        if (lists[g] == NULL)
+            return;     // some trigram occurs nowhere
+        if (lists[g]->n < lists[shortest]->n)
+            shortest = g;
+    }
+
+    const posting *drive = lists[shortest];
+    for (uint32_t k = 0; k < drive->n; k++) {
+        uint32_t id = drive->ids[newest_first ? drive->n - 1 - k : k];
+        uint64_t seq = idx->base + id;
+        if (seq < oldest) {
+            if (newest_first)
+                return;
+            continue;
+        }
+
+        bool candidate = true;
+        for (size_t g = 0; g < ngrams && candidate; g++)
+            candidate = g == shortest || contains(lists[g], id);
+        if (candidate && read_entry(h, seq, buf, sizeof(buf), NULL) >= 0 &&
+            matches(buf, pattern, prefix) && !visit(seq, buf, arg))
+            return;
+    }
+}
+
+static bool print_entry(uint64_t seq, const char *text, void *arg)
+{
+    (void)arg;
+    printf("%5llu  %s\n", (unsigned long long)seq + 1, text);
+    return true;
+}
+
+void history_print(command_history_t *h, const char *pattern)
+{
+    if (pattern != NULL) {
+        search(h, pattern, false, false, print_entry, NULL);
+        return;
+    }
+
+    char buf[HIST_MAX_LINE];
+    uint64_t end = history_end(h);
+    for (uint64_t seq = oldest_entry(h, end); seq < end; seq++)
+        if (read_entry(h, seq, buf, sizeof(buf), NULL) >= 0)
+            print_entry(seq, buf, NULL);
+}
+
+typedef struct {
+    char *buf;
+    size_t size;
+    bool found;
+} prefix_match;
+
+static bool copy_match(uint64_t seq, const char *text, void *arg)
+{
+    (void)seq;
+    prefix_match *m = arg;
+    snprintf(m->buf, m->size, "%s", text);
+    m->found = true;
+    return false;   // the newest match is enough
+}
+
+bool history_find_prefix(command_history_t *h, const char *prefix, char *buf, size_t size)
+{
+    prefix_match m = { buf, size, false };
+    search(h, prefix, true, true, copy_match, &m);
+    return m.found;
+}
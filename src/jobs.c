@@ -0,0 +1,409 @@
+#include "job.h"
+#include "timeout.h"
+#include "vars.h"
+#include "stats.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+static int chld_fd = -1;    // signalfd for SIGCHLD
+
+static size_t bucket(const job_list_t *jobs, unsigned long key)
+{
+    // Fibonacci hashing spreads sequential pids and job numbers
+    return (key * 11400714819323198485ULL) >> 32 & (jobs->nbuckets - 1);
+}
+
+static void index_job(job_list_t *jobs, job_t *job)
+{
+    for (int i = 0; i < job->nprocs; i++) {
+        process_t *proc = &job->procs[i];
+        size_t b = bucket(jobs, (unsigned long)proc->pid);
+        proc->chain = jobs->by_pid[b];
+        jobs->by_pid[b] = proc;
+    }
+
+    size_t b = bucket(jobs, (unsigned long)job->job_num);
+    job->num_chain = jobs->by_num[b];
+    jobs->by_num[b] = job;
+}
+
+static void grow_index(job_list_t *jobs, int nprocs)
+{
+    size_t nbuckets = jobs->nbuckets ? jobs->nbuckets : 16;
+    while (nbuckets < (size_t)nprocs)
+        nbuckets *= 2;
+    if (nbuckets == jobs->nbuckets)
+        nbuckets *= 2;
+
+    free(jobs->by_pid);
+    free(jobs->by_num);
+    jobs->nbuckets = nbuckets;
+    jobs->by_pid = calloc(jobs->nbuckets, sizeof(process_t *));
+    jobs->by_num = calloc(jobs->nbuckets, sizeof(job_t *));
+
+    for (job_t *job = jobs->head; job != NULL; job = job->next)
+        index_job(jobs, job);
+}
+
+/**
+ * Creates a job for `npids` started processes (pipeline stages) without
+ * registering it; foreground commands use one to collect their usage.
+ */
+job_t *new_job(const pid_t *pids, int npids, const char *cmd) {
+    // The job and its processes share one allocation
+    job_t *job = calloc(1, sizeof(job_t) + npids * sizeof(process_t));
+    job->procs = (process_t *)(job + 1);
+    job->nprocs = npids;
+    job->nlive = npids;
+    for (int i = 0; i < npids; i++) {
+        job->procs[i].pid = pids[i];
+        job->procs[i].job = job;
+    }
+
+    job->pid = pids[npids - 1];
+    job->command = strdup(cmd);
+    job->status = 0;  // Running
+    clock_gettime(CLOCK_MONOTONIC, &job->started);
+    return job;
+}
+
+void free_job(job_t *job) {
+    free(job->command);
+    free(job);
+}
+
+/**
+ * Registers a background job made of `npids` processes (pipeline stages)
+ * and returns it. Like sh, the new job is numbered one past the newest
+ * running job, so numbers start again from 1 once every job has finished.
+ */
+job_t *add_job(job_list_t *jobs, const pid_t *pids, int npids, const char *cmd) {
+    if ((size_t)(jobs->nprocs + npids) > jobs->nbuckets)
+        grow_index(jobs, jobs->nprocs + npids);
+
+    job_t *job = new_job(pids, npids, cmd);
+    job->job_num = jobs->tail ? jobs->tail->job_num + 1 : 1;
+    job->timed = jobs->time_next;
+
+    job->prev = jobs->tail;
+    job->next = NULL;
+    if (jobs->tail)
+        jobs->tail->next = job;
+    else
+        jobs->head = job;
+    jobs->tail = job;
+
+    index_job(jobs, job);
+    jobs->count++;
+    jobs->nprocs += npids;
+    jobs->next_job_num = job->job_num + 1;
+    return job;
+}
+
+job_t *find_job(job_list_t *jobs, int job_num) {
+    if (jobs->nbuckets == 0)
+        return NULL;
+    job_t *job = jobs->by_num[bucket(jobs, (unsigned long)job_num)];
+    while (job != NULL && job->job_num != job_num)
+        job = job->num_chain;
+    return job;
+}
+
+static process_t *find_process(job_list_t *jobs, pid_t pid) {
+    if (jobs->nbuckets == 0)
+        return NULL;
+    process_t *proc = jobs->by_pid[bucket(jobs, (unsigned long)pid)];
+    while (proc != NULL && proc->pid != pid)
+        proc = proc->chain;
+    return proc;
+}
+
+job_t *find_job_by_pid(job_list_t *jobs, pid_t pid) {
+    process_t *proc = find_process(jobs, pid);
+    return proc ? proc->job : NULL;
+}
+
+void remove_job(job_list_t *jobs, job_t *job) {
+    for (int i = 0; i < job->nprocs; i++) {
+        process_t **link = &jobs->by_pid[bucket(jobs, (unsigned long)job->procs[i].pid)];
+        while (*link != &job->procs[i])
+            link = &(*link)->chain;
+        *link = job->procs[i].chain;
+    }
+
+    job_t **link = &jobs->by_num[bucket(jobs, (unsigned long)job->job_num)];
+    while (*link != job)
+        link = &(*link)->num_chain;
+    *link = job->num_chain;
+
+    if (job->prev)
+        job->prev->next = job->next;
+    else
+        jobs->head = job->next;
+    if (job->next)
+        job->next->prev = job->prev;
+    else
+        jobs->tail = job->prev;
+
+    jobs->count--;
+    jobs->nprocs -= job->nprocs;
+    jobs->next_job_num = jobs->tail ? jobs->tail->job_num + 1 : 1;
+    free_job(job);
+}
+
+void free_jobs(job_list_t *jobs) {
+    while (jobs->head)
+        remove_job(jobs, jobs->head);
+    free(jobs->by_pid);
+    free(jobs->by_num);
+    jobs->by_pid = NULL;
+    jobs->by_num = NULL;
+    jobs->nbuckets = 0;
+}
+
+// Converts a waitpid() status to a shell exit status ($?)
+int exit_status(int status) {
+    if (WIFSIGNALED(status))
+        return 128 + WTERMSIG(status);
+    return WEXITSTATUS(status);
+}
+
+int jobs_init_signals(void) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+
+    chld_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (chld_fd < 0)
+        perror("signalfd");
+    return chld_fd;
+}
+
+static void drain_signalfd(void) {
+    struct signalfd_siginfo info[16];
+    if (chld_fd < 0)
+        return;
+    while (read(chld_fd, info, sizeof(info)) == (ssize_t)sizeof(info))
+        ;
+}
+
+static double elapsed(struct timespec from, struct timespec to) {
+    return (to.tv_sec - from.tv_sec) + (to.tv_nsec - from.tv_nsec) / 1e9;
+}
+
+static double seconds(struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void print_usage_row(const char *label, double real, const struct rusage *ru) {
+    fprintf(stderr, "%-6s %8.3fs %8.3fs %8.3fs %8ldk %7ld %7ld\n", label, real,
+            seconds(ru->ru_utime), seconds(ru->ru_stime),
+            ru->ru_maxrss, ru->ru_majflt, ru->ru_minflt);
+}
+
+/**
+ * Prints the wall, user and sys time, max RSS and page faults of a
+ * finished job to stderr: one row per pipeline stage, then the total.
+ * Jobs started with the time prefix are always reported; others when
+ * their CPU time reaches $REPORTTIME seconds (REPORTTIME=0: every job).
+ */
+static void report_usage(const job_t *job) {
+    struct rusage total = { 0 };
+    for (int i = 0; i < job->nprocs; i++) {
+        const struct rusage *ru = &job->procs[i].usage;
+        timeradd(&total.ru_utime, &ru->ru_utime, &total.ru_utime);
+        timeradd(&total.ru_stime, &ru->ru_stime, &total.ru_stime);
+        if (ru->ru_maxrss > total.ru_maxrss)
+            total.ru_maxrss = ru->ru_maxrss;    // stages overlap in time
+        total.ru_majflt += ru->ru_majflt;
+        total.ru_minflt += ru->ru_minflt;
+    }
+
+    if (!job->timed) {
+        const char *threshold = vars_get("REPORTTIME");
+        if (threshold == NULL || *threshold == '\0' ||
+            seconds(total.ru_utime) + seconds(total.ru_stime) < atof(threshold))
+            return;
+    }
+
+    fflush(stdout);
+    fprintf(stderr, "%-6s %9s %9s %9s %9s %7s %7s  %s\n", "stage", "real", "user", "sys",
+            "maxrss", "majflt", "minflt", job->command);
+    struct timespec ended = job->started;
+    for (int i = 0; i < job->nprocs; i++) {
+        const process_t *proc = &job->procs[i];
+        if (proc->ended.tv_sec > ended.tv_sec ||
+            (proc->ended.tv_sec == ended.tv_sec && proc->ended.tv_nsec > ended.tv_nsec))
+            ended = proc->ended;
+        if (job->nprocs > 1) {
+            char label[16];
+            snprintf(label, sizeof(label), "%d", i + 1);
+            print_usage_row(label, elapsed(job->started, proc->ended), &proc->usage);
+        }
+    }
+    print_usage_row("total", elapsed(job->started, ended), &total);
+}
+
+/**
+ * Reaps one exited child with a single wait4(-1) call, which also
+ * returns its resource usage.
+ * Returns false when there is nothing (more) to reap. If the child was
+ * the last live stage of a job, *completed is set to that job, with its
+ * status filled in; it is still on the list for the caller to report.
+ */
+static bool reap_one(job_list_t *jobs, bool block, job_t **completed) {
+    *completed = NULL;
+
+    int status;
+    struct rusage usage;
+    pid_t pid = wait4(-1, &status, block ? 0 : WNOHANG, &usage);
+    if (pid < 0) {
+        if (errno == EINTR)
+            return true;
+        return false;   // ECHILD: no children left
+    }
+    if (pid == 0)
+        return false;
+
+    process_t *proc = find_process(jobs, pid);
+    if (proc == NULL || proc->done)
+        return true;    // not one of ours (already waited for elsewhere)
+
+    proc->done = true;
+    proc->status = timeout_reaped(pid, status);
+    proc->usage = usage;
+    clock_gettime(CLOCK_MONOTONIC, &proc->ended);
+
+    job_t *job = proc->job;
+    if (--job->nlive == 0) {
+        // the job's status is that of its last stage
+        job->status = job->procs[job->nprocs - 1].status;
+        *completed = job;
+    }
+    return true;
+}
+
+/**
+ * Waits for every stage of a foreground job (one made by new_job) and
+ * returns its exit status, reporting its resource usage if wanted.
+ */
+int wait_foreground(job_t *job) {
+    STATS_BEGIN(t);
+    for (int i = 0; i < job->nprocs; i++) {
+        process_t *proc = &job->procs[i];
+        proc->status = timeout_wait(proc->pid, &proc->usage);
+        proc->done = true;
+        clock_gettime(CLOCK_MONOTONIC, &proc->ended);
+    }
+    job->nlive = 0;
+    job->status = job->procs[job->nprocs - 1].status;
+    STATS_END(STAT_WAIT, t);
+    report_usage(job);
+    return job->status;
+}
+
+// Announces a completed job (interactive shells) and removes it
+void finish_job(job_list_t *jobs, job_t *job) {
+    if (jobs->notify) {
+        printf("[%d] + complete %s\n", job->job_num, job->command);
+        fflush(stdout);
+    }
+    report_usage(job);
+    remove_job(jobs, job);
+}
+
+/**
+ * Reaps every child that has exited since the last call, without
+ * visiting running jobs. Returns the number of jobs that completed.
+ */
+int check_jobs(job_list_t *jobs) {
+    drain_signalfd();
+
+    int finished = 0;
+    job_t *job;
+    while (reap_one(jobs, false, &job)) {
+        if (job != NULL) {
+            finish_job(jobs, job);
+            finished++;
+        }
+    }
+    return finished;
+}
+
+/**
+ * Blocks until the next job completes and returns it, still on the list
+ * for the caller to report or remove. Returns NULL if no job is running.
+ * Timeouts armed on running jobs keep firing while it sleeps.
+ */
+job_t *wait_any_job(job_list_t *jobs) {
+    while (jobs->count > 0) {
+        job_t *job;
+        errno = 0;
+        if (reap_one(jobs, chld_fd < 0, &job)) {
+            if (job != NULL)
+                return job;
+            continue;
+        }
+        if (errno == ECHILD || chld_fd < 0)
+            break;
+
+        // SIGCHLD stays pending on the signalfd, so an exit that races
+        // with the reap above still wakes the poll
+        struct pollfd fds[2] = {
+            { .fd = chld_fd, .events = POLLIN },
+            { .fd = timeout_fd(), .events = POLLIN },
+        };
+        if (poll(fds, 2, -1) < 0 && errno != EINTR)
+            break;
+        if (fds[1].revents & POLLIN)
+            timeout_dispatch();
+        drain_signalfd();
+    }
+    return NULL;
+}
+
+void wait_for_jobs(job_list_t *jobs) {
+    wait_jobs(jobs, NULL, 0, false);
+}
+
+/**
+ * Blocks until the given jobs (all jobs when n == 0) have finished, or
+ * until the first of them finishes when `any` is set, in whatever order
+ * they exit. Returns the exit status of the last job waited for; with
+ * `any`, 127 if none was left to wait for, as in bash.
+ */
+int wait_jobs(job_list_t *jobs, const int *job_nums, int n, bool any) {
+    int remaining = n;
+    int last_status = any ? 127 : 0;
+
+    while (n == 0 || remaining > 0) {
+        job_t *job = wait_any_job(jobs);
+        if (job == NULL)
+            break;
+
+        bool wanted = (n == 0);
+        for (int i = 0; i < n; i++) {
+            if (job_nums[i] == job->job_num) {
+                wanted = true;
+                remaining--;
+            }
+        }
+        if (wanted)
+            last_status = job->status;
+        finish_job(jobs, job);
+
+        if (wanted && any)
+            break;
+    }
+    return last_status;
+}
@@ -0,0 +1,140 @@
+#include "launch.h"
+#include "vars.h"
+#include "stats.h"
+#include "zygote.h"
+
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+launch_mode_t launch_mode = LAUNCH_SPAWN;
+
+static pid_t launch_spawn(const launch_t *l)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+
+    // Redirection and pipe fds are opened O_CLOEXEC by the parent, so
+    // dup2 onto 0/1 is the only action needed; the originals close on exec.
+    if (l->in_fd >= 0)
+        posix_spawn_file_actions_adddup2(&actions, l->in_fd, STDIN_FILENO);
+    if (l->out_fd >= 0)
+        posix_spawn_file_actions_adddup2(&actions, l->out_fd, STDOUT_FILENO);
+    if (l->err_fd >= 0)
+        posix_spawn_file_actions_adddup2(&actions, l->err_fd, STDERR_FILENO);
+
+    // The shell blocks SIGCHLD (it is read from a signalfd); children
+    // must start with an empty mask
+    posix_spawnattr_t attr;
+    sigset_t empty;
+    sigemptyset(&empty);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigmask(&attr, &empty);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+    pid_t pid;
+    int err = posix_spawn(&pid, l->path, &actions, &attr, l->argv, l->envp);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+
+    if (err != 0) {
+        fprintf(stderr, "%s: %s\n", l->path, strerror(err));
+        return -1;
+    }
+    return pid;
+}
+
+static pid_t launch_fork(const launch_t *l)
+{
+    pid_t pid = fork();
+
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+
+    if (pid == 0) {
+        // Child process: install fds and execute
+        sigset_t empty;
+        sigemptyset(&empty);
+        sigprocmask(SIG_SETMASK, &empty, NULL);
+        if (l->in_fd >= 0)
+            dup2(l->in_fd, STDIN_FILENO);
+        if (l->out_fd >= 0)
+            dup2(l->out_fd, STDOUT_FILENO);
+        if (l->err_fd >= 0)
+            dup2(l->err_fd, STDERR_FILENO);
+        execve(l->path, l->argv, l->envp);
+        perror("execve");
+        _exit(127);
+    }
+    return pid;
+}
+
+// Falls back to posix_spawn when the helper cannot serve this launch
+// (it is gone, or this is a forked subshell)
+static pid_t launch_zygote(const launch_t *l)
+{
+    int pidfd;
+    pid_t pid = zygote_launch(l, &pidfd);
+    if (pid < 0)
+        return launch_spawn(l);
+    // the child is the shell's own, so its pid is as safe as the pidfd
+    // until it is reaped
+    if (pidfd >= 0)
+        close(pidfd);
+    return pid;
+}
+
+pid_t launch(const launch_t *l)
+{
+    STATS_BEGIN(t);
+    launch_t with_env = *l;
+    if (with_env.envp == NULL)
+        with_env.envp = vars_environ();
+
+    pid_t pid;
+    switch (launch_mode) {
+    case LAUNCH_FORK:
+        pid = launch_fork(&with_env);
+        break;
+    case LAUNCH_ZYGOTE:
+        pid = launch_zygote(&with_env);
+        break;
+    default:
+        pid = launch_spawn(&with_env);
+        break;
+    }
+    STATS_END(STAT_SPAWN, t);
+    return pid;
+}
+
+static const char *mode_names[] = { "spawn", "fork", "zygote" };
+
+bool launch_set_mode(const char *name)
+{
+    for (size_t i = 0; i < sizeof(mode_names) / sizeof(mode_names[0]); i++) {
+        if (strcmp(name, mode_names[i]) != 0)
+            continue;
+        if (i == LAUNCH_ZYGOTE && !zygote_start())
+            return false;
+        launch_mode = (launch_mode_t)i;
+        return true;
+    }
+    return false;
+}
+
+const char *launch_mode_name(void)
+{
+    return mode_names[launch_mode];
+}
+
+void launch_init(void)
+{
+    const char *mode = vars_get("SHELL_LAUNCHER");
+    if (mode != NULL && !launch_set_mode(mode))
+        fprintf(stderr, "SHELL_LAUNCHER: unknown mode '%s' (use spawn, fork or zygote)\n", mode);
+}
@@ -1,7 +1,11 @@
 #include "lexer.h"
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
 
 int lexer_main()
 {
@@ -13,79 +17,373 @@ int lexer_main()
 		 */
 
 		char *input = get_input();
+		if (input == NULL)
+			break;
 		printf("whole input: %s\n", input);
 
 		tokenlist *tokens = get_tokens(input);
+		if (tokens->status == LEX_OPEN_QUOTE)
+			printf("syntax error: unterminated quote\n");
 		for (size_t i = 0; i < tokens->size; i++) {
 			printf("token %zu: (%s)\n", i, tokens->items[i]);
 		}
 
-		free(input);
 		free_tokens(tokens);
 	}
 
 	return 0;
 }
 
-char *get_input(void) {
-	char *buffer = NULL;
-	int bufsize = 0;
-	char line[5];
-	while (fgets(line, 5, stdin) != NULL)
-	{
-		int addby = 0;
-		char *newln = strchr(line, '\n');
-		if (newln != NULL)
-			addby = newln - line;
+void reader_init(line_reader *r, int fd) {
+	r->fd = fd;
+	r->buf = NULL;
+	r->cap = 0;
+	r->start = 0;
+	r->end = 0;
+	r->eof = false;
+	r->notify_fd = -1;
+	r->on_notify = NULL;
+	r->notify_arg = NULL;
+}
+
+/* Serves `s` as if it had been read from a file (shell -c) */
+void reader_init_string(line_reader *r, const char *s) {
+	size_t len = strlen(s);
+	reader_init(r, -1);
+	r->cap = len + 1;
+	r->buf = (char *)malloc(r->cap);
+	memcpy(r->buf, s, len);
+	r->end = len;
+	r->eof = true;
+}
+
+void reader_free(line_reader *r) {
+	free(r->buf);
+	if (r->fd > STDIN_FILENO)
+		close(r->fd);
+	reader_init(r, -1);
+}
+
+/* Returns the next line without its newline, NUL-terminated inside the
+ * reader's buffer, or NULL once the input is exhausted. The pointer stays
+ * valid until the next call. Input is pulled in READER_BLOCK-sized read()s
+ * and bytes past the line are kept for the following call.
+ */
+char *reader_getline(line_reader *r, size_t *len) {
+	size_t scanned = r->start;
+
+	while (1) {
+		char *nl = r->end > scanned ? memchr(r->buf + scanned, '\n', r->end - scanned) : NULL;
+		if (nl != NULL) {
+			char *line = r->buf + r->start;
+			*nl = '\0';
+			if (len)
+				*len = nl - line;
+			r->start = nl - r->buf + 1;
+			return line;
+		}
+		scanned = r->end;
+
+		if (r->eof) {
+			if (r->start == r->end)
+				return NULL;
+			/* last line without a trailing newline */
+			char *line = r->buf + r->start;
+			r->buf[r->end] = '\0';
+			if (len)
+				*len = r->end - r->start;
+			r->start = r->end;
+			return line;
+		}
+
+		/* make room: slide the partial line to the front, grow if it fills the buffer */
+		if (r->start > 0) {
+			memmove(r->buf, r->buf + r->start, r->end - r->start);
+			r->end -= r->start;
+			scanned -= r->start;
+			r->start = 0;
+		}
+		if (r->cap - r->end < READER_BLOCK + 1) {
+			r->cap = r->cap ? r->cap * 2 : READER_BLOCK * 2;
+			r->buf = (char *)realloc(r->buf, r->cap);
+		}
+
+		if (r->notify_fd >= 0) {
+			struct pollfd fds[2] = {
+				{ .fd = r->fd, .events = POLLIN },
+				{ .fd = r->notify_fd, .events = POLLIN },
+			};
+			if (poll(fds, 2, -1) < 0) {
+				if (errno == EINTR)
+					continue;
+			} else if (fds[1].revents & POLLIN) {
+				r->on_notify(r->notify_arg);
+				if (!fds[0].revents)
+					continue;
+			}
+		}
+
+		ssize_t n = read(r->fd, r->buf + r->end, r->cap - r->end - 1);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			r->eof = true;
 		else
-			addby = 5 - 1;
-		buffer = (char *)realloc(buffer, bufsize + addby);
-		memcpy(&buffer[bufsize], line, addby);
-		bufsize += addby;
-		if (newln != NULL)
-			break;
+			r->end += n;
 	}
-	buffer = (char *)realloc(buffer, bufsize + 1);
-	buffer[bufsize] = 0;
-	return buffer;
 }
 
-tokenlist *new_tokenlist(void) {
-	tokenlist *tokens = (tokenlist *)malloc(sizeof(tokenlist));
+char *get_input(void) {
+	static line_reader stdin_reader = { .fd = STDIN_FILENO, .notify_fd = -1 };
+	return reader_getline(&stdin_reader, NULL);
+}
+
+struct token_chunk {
+	struct token_chunk *next;
+	size_t used;
+	size_t cap;
+	char data[];
+};
+
+/* Operator tokens point into this one array, so is_any_operator() is a
+ * range check and quoted or expanded text can never become an operator.
+ * The single-character operators come first, in operator_chars order.
+ */
+static const char operator_chars[] = "|<>&;()\n";
+static const char operator_text[] = "|\0<\0>\0&\0;\0(\0)\0\n\0&&\0||";
+#define OPERATOR(i) ((char *)operator_text + 2 * (i))
+#define OPERATOR_AND OPERATOR(8)
+#define OPERATOR_OR ((char *)operator_text + 19)
+
+/* Characters that end a run of plain word characters */
+#define WORD_BREAKS " \t\n|<>&;()'\"\\"
+
+bool is_any_operator(const char *tok) {
+	return tok >= operator_text && tok < operator_text + sizeof(operator_text);
+}
+
+bool is_operator(const char *tok, const char *op) {
+	return is_any_operator(tok) && strcmp(tok, op) == 0;
+}
+
+/* One malloc holds the list header, `slots` item pointers (+ NULL) and a
+ * `chars`-byte arena for the split strings.
+ */
+static tokenlist *alloc_tokenlist(size_t slots, size_t chars, char **arena) {
+	size_t items_size = (slots + 1) * sizeof(char *);
+	tokenlist *tokens = (tokenlist *)malloc(sizeof(tokenlist) + items_size + chars);
+	tokens->items = (char **)(tokens + 1);
 	tokens->size = 0;
-	tokens->items = (char **)malloc(sizeof(char *));
+	tokens->capacity = slots;
+	tokens->extra = NULL;
+	tokens->status = LEX_OK;
+	tokens->assignments = NULL;
+	tokens->nassignments = 0;
 	tokens->items[0] = NULL; /* make NULL terminated */
+	if (arena)
+		*arena = (char *)tokens->items + items_size;
 	return tokens;
 }
 
+static bool items_inline(tokenlist *tokens) {
+	return tokens->items == (char **)(tokens + 1);
+}
+
+tokenlist *new_tokenlist(void) {
+	return alloc_tokenlist(0, 0, NULL);
+}
+
+char *tokens_alloc(tokenlist *tokens, size_t len) {
+	struct token_chunk *chunk = tokens->extra;
+	if (chunk == NULL || chunk->cap - chunk->used < len) {
+		size_t cap = len > 1024 ? len : 1024;
+		chunk = (struct token_chunk *)malloc(sizeof(struct token_chunk) + cap);
+		chunk->used = 0;
+		chunk->cap = cap;
+		chunk->next = tokens->extra;
+		tokens->extra = chunk;
+	}
+	char *p = chunk->data + chunk->used;
+	chunk->used += len;
+	return p;
+}
+
+char *tokens_strdup(tokenlist *tokens, const char *s) {
+	size_t len = strlen(s) + 1;
+	return (char *)memcpy(tokens_alloc(tokens, len), s, len);
+}
+
 void add_token(tokenlist *tokens, char *item) {
-	int i = tokens->size;
+	if (tokens->size == tokens->capacity) {
+		size_t cap = tokens->capacity * 2 + 4;
+		char **items = (char **)malloc((cap + 1) * sizeof(char *));
+		memcpy(items, tokens->items, tokens->size * sizeof(char *));
+		if (!items_inline(tokens))
+			free(tokens->items);
+		tokens->items = items;
+		tokens->capacity = cap;
+	}
 
-	tokens->items = (char **)realloc(tokens->items, (i + 2) * sizeof(char *));
-	tokens->items[i] = (char *)malloc(strlen(item) + 1);
-	tokens->items[i + 1] = NULL;
-	strcpy(tokens->items[i], item);
+	tokens->items[tokens->size++] = tokens_strdup(tokens, item);
+	tokens->items[tokens->size] = NULL;
+}
 
-	tokens->size += 1;
+/* The word so far, quotes removed, reads NAME=... */
+static bool reads_as_assignment(const char *s, const char *end) {
+	if (s == end || !(isalpha((unsigned char)*s) || *s == '_'))
+		return false;
+	while (++s < end && (isalnum((unsigned char)*s) || *s == '_'))
+		;
+	return s < end && *s == '=';
 }
 
+/* Splits a line into tokens without touching `input`.
+ * Quotes and backslashes are removed here; characters they protect from
+ * expansion ($ and ~) are prefixed with CTLESC. A word whose NAME= was
+ * (partly) quoted starts with CTLESC too, so it is not taken for an
+ * assignment. | < > & ; ( ) && || and newline are tokens of their own
+ * whether or not they are surrounded by spaces.
+ */
 tokenlist *get_tokens(char *input) {
-	char *buf = (char *)malloc(strlen(input) + 1);
-	strcpy(buf, input);
-	tokenlist *tokens = new_tokenlist();
-	char *tok = strtok(buf, " ");
-	while (tok != NULL)
-	{
-		add_token(tokens, tok);
-		tok = strtok(NULL, " ");
+	size_t len = strlen(input);
+	char *out;
+	/* Each token consumes at least one input character, and escaping at
+	 * most doubles a character, so len slots and 2*len+1 bytes suffice.
+	 */
+	tokenlist *tokens = alloc_tokenlist(len, 2 * len + 1, &out);
+	const char *p = input;
+
+	while (1) {
+		p += strspn(p, " \t");
+		if (*p == '\0')
+			break;
+
+		/* a comment runs to the end of the line */
+		if (*p == '#') {
+			p += strcspn(p, "\n");
+			continue;
+		}
+
+		const char *op = strchr(operator_chars, *p);
+		if (op != NULL) {
+			if ((*p == '&' || *p == '|') && p[1] == *p) {
+				tokens->items[tokens->size++] = *p == '&' ? OPERATOR_AND : OPERATOR_OR;
+				p += 2;
+				continue;
+			}
+			tokens->items[tokens->size++] = OPERATOR(op - operator_chars);
+			p++;
+			continue;
+		}
+
+		char *start = out;
+		bool quoted = false;		/* quoting came before any plain '=' */
+		bool seen_quote = false;
+		while (1) {
+			/* copy the plain run up to the next special character in bulk */
+			size_t n = strcspn(p, WORD_BREAKS);
+			memcpy(out, p, n);
+			out += n;
+			p += n;
+
+			if (!seen_quote && (*p == '\'' || *p == '"' || (*p == '\\' && p[1] != '\n'))) {
+				seen_quote = true;
+				quoted = memchr(start, '=', out - start) == NULL;
+			}
+
+			if (*p == '\'') {
+				const char *end = strchr(p + 1, '\'');
+				if (end == NULL)
+					goto unterminated;
+				for (p++; p < end; p++) {
+					if (*p == '$' || *p == '~')
+						*out++ = CTLESC;
+					*out++ = *p;
+				}
+				p++;
+			} else if (*p == '"') {
+				for (p++; *p != '"'; p++) {
+					if (*p == '\0')
+						goto unterminated;
+					if (*p == '\\' && p[1] != '\0' && strchr("$`\"\\\n", p[1])) {
+						p++;
+						if (*p == '\n')
+							continue;
+						if (*p == '$')
+							*out++ = CTLESC;
+					} else if (*p == '~') {
+						*out++ = CTLESC;
+					}
+					*out++ = *p;
+				}
+				p++;
+			} else if (*p == '\\') {
+				p++;
+				if (*p == '\0')
+					break;
+				if (*p != '\n') {  /* backslash-newline joins lines */
+					if (*p == '$' || *p == '~')
+						*out++ = CTLESC;
+					*out++ = *p;
+				}
+				p++;
+			} else {
+				break;
+			}
+		}
+		/* a quote paid for the extra byte */
+		if (quoted && reads_as_assignment(start, out)) {
+			memmove(start + 1, start, out - start);
+			*start = CTLESC;
+			out++;
+		}
+		*out++ = '\0';
+		tokens->items[tokens->size++] = start;
+	}
+
+	tokens->items[tokens->size] = NULL;
+	return tokens;
+
+unterminated:
+	/* reported by the caller: the quote may close on a later line */
+	tokens->status = LEX_OPEN_QUOTE;
+	tokens->size = 0;
+	tokens->items[0] = NULL;
+	return tokens;
+}
+
+/* A list of its own holding copies of n items; operators stay operators */
+tokenlist *copy_tokens(char *const *items, size_t n) {
+	size_t chars = 0;
+	for (size_t i = 0; i < n; i++)
+		if (!is_any_operator(items[i]))
+			chars += strlen(items[i]) + 1;
+
+	char *out;
+	tokenlist *tokens = alloc_tokenlist(n, chars, &out);
+	for (size_t i = 0; i < n; i++) {
+		if (is_any_operator(items[i])) {
+			tokens->items[i] = items[i];
+			continue;
+		}
+		size_t len = strlen(items[i]) + 1;
+		tokens->items[i] = memcpy(out, items[i], len);
+		out += len;
 	}
-	free(buf);
+	tokens->size = n;
+	tokens->items[n] = NULL;
 	return tokens;
 }
 
 void free_tokens(tokenlist *tokens) {
-	for (size_t i = 0; i < tokens->size; i++)
-		free(tokens->items[i]);
-	free(tokens->items);
+	struct token_chunk *chunk = tokens->extra;
+	while (chunk != NULL) {
+		struct token_chunk *next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+	if (!items_inline(tokens))
+		free(tokens->items);
+	free(tokens->assignments);
 	free(tokens);
 }
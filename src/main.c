@@ -1,7 +1,23 @@
+#define _GNU_SOURCE
+
 #include <pwd.h>
+#include <fcntl.h>
+#include <errno.h>
+
 
 #include "lexer.h"
 #include "job.h"
+#include "path.h"
+#include "launch.h"
+#include "parallel.h"
+#include "timeout.h"
+#include "prompt.h"
+#include "history.h"
+#include "vars.h"
+#include "builtins.h"
+#include "parser.h"
+#include "exec.h"
+#include "stats.h"
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -9,372 +25,196 @@
 #include <limits.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
+#include <time.h>
 
-static char *expand_tilde(const char *tok);
-void add_job(job_list_t *jobs, pid_t pid, const char *cmd);
-
-void print_prompt(void)
-{
-    char* user = getenv("USER");
-
-    char hostname[256];
-    gethostname(hostname, sizeof(hostname));
-
-    char pwd[PATH_MAX];
-    getcwd(pwd, sizeof(pwd));
-
-    printf("%s@%s:%s> ", user, hostname, pwd);
-    fflush(stdout);
-}
-
-void expand_tokens(tokenlist *tokens) {
-    for (size_t i = 0; i < tokens->size; i++) {
-        char *tok = tokens->items[i];
-       
-	if(tok[0]=='~'){  //Tilde Expansion
-	 char *newtok = expand_tilde(tok);
-	 free(tokens->items[i]);
-	 tokens->items[i]=newtok;
-	 tok = tokens->items[i];}
-
-	 if (tok[0] == '$') {
-            char *var_name = tok + 1; 
-            char *value = getenv(var_name);
-
-            if (value != NULL) {
-                free(tokens->items[i]);                 
-                tokens->items[i] = strdup(value);      
-            }
-            else {
-                free(tokens->items[i]);
-                tokens->items[i] = strdup("");
-            }
-        }
-    }
-}
+static bool interactive = false;    // prompt, job notices, exit summary
 
 /**
- * Searches for a command in $PATH directories.
- * Returns the full path if found, NULL otherwise.
- * Caller must free the returned string.
+ * Replaces a leading !prefix (or !! for the last command) with the newest
+ * history entry starting with prefix, keeping the rest of the line.
+ * Returns the line to run: `line` itself, `out`, or NULL if no entry matches.
  */
-char *search_path(const char *command) {
-    // If command contains '/', don't search PATH
-    if (strchr(command, '/') != NULL) {
-        if (access(command, X_OK) == 0) {
-            return strdup(command);
-        }
-        return NULL;
-    }
-
-    char *path_env = getenv("PATH");
-    if (path_env == NULL) {
+static char *expand_history(command_history_t *history, char *line, char *out, size_t size) {
+    if (line[0] != '!' || line[1] == '\0' || strchr(" \t=", line[1]) != NULL)
+        return line;
+
+    size_t n = strcspn(line + 1, " \t");
+    char prefix[HIST_MAX_LINE];
+    snprintf(prefix, sizeof(prefix), "%.*s", (int)n, line + 1);
+    if (!history_find_prefix(history, strcmp(prefix, "!") == 0 ? "" : prefix, out, size)) {
+        fprintf(stderr, "!%s: event not found\n", prefix);
         return NULL;
     }
+    strncat(out, line + 1 + n, size - strlen(out) - 1);
 
-    // Make a copy since strtok modifies the string
-    char *path_copy = strdup(path_env);
-    char *dir = strtok(path_copy, ":");
-
-    while (dir != NULL) {
-        // Build full path: dir + "/" + command
-        char full_path[PATH_MAX];
-        snprintf(full_path, sizeof(full_path), "%s/%s", dir, command);
-
-        // Check if file exists and is executable
-        if (access(full_path, X_OK) == 0) {
-            free(path_copy);
-            return strdup(full_path);
-        }
-
-        dir = strtok(NULL, ":");
+    // like sh, show what is about to run
+    if (interactive) {
+        printf("%s\n", out);
+        fflush(stdout);
     }
-
-    free(path_copy);
-    return NULL;
+    return out;
 }
 
-/**
- * Executes an external command using fork/exec.
- */
-void execute_command(char *cmd_path, tokenlist *tokens, bool background, job_list_t *jobs) {
-    pid_t pid = fork();
-
-    if (pid < 0) {
-        perror("fork");
-        return;
-    }
-
-    if (pid == 0) {
-        // Child process: execute
-        char **argv = malloc((tokens->size + 1) * sizeof(char *));
-        for (size_t i = 0; i < tokens->size; i++) {
-            argv[i] = tokens->items[i];
-        }
-        argv[tokens->size] = NULL;
-        execv(cmd_path, argv);
-        perror("execv");
-        exit(EXIT_FAILURE);
-    } else {
-        // Parent process
-        if (background) {
-            // Build command string from tokens
-            char cmd_str[1024] = "";
-            for (size_t i = 0; i < tokens->size; i++) {
-                strncat(cmd_str, tokens->items[i], sizeof(cmd_str) - strlen(cmd_str) - 1);
-                if (i < tokens->size - 1) {
-                    strncat(cmd_str, " ", sizeof(cmd_str) - strlen(cmd_str) - 1);
-                }
-            }
-            
-            // Add to job list
-            add_job(jobs, pid, cmd_str);
-            printf("[%d] %d\n", jobs->jobs[jobs->count - 1].job_num, pid);
-        } else {
-            // Wait for child
-            int status;
-            waitpid(pid, &status, 0);
-        }
-    }
-}
 
-void add_job(job_list_t *jobs, pid_t pid, const char *cmd) {
-    if (jobs->count >= 10) return;
-    
-    jobs->jobs[jobs->count].job_num = jobs->next_job_num++;
-    jobs->jobs[jobs->count].pid = pid;
-    jobs->jobs[jobs->count].command = strdup(cmd);
-    jobs->jobs[jobs->count].status = 0;  // Running
-    jobs->count++;
+static void notify_jobs(void *jobs) {
+    timeout_dispatch();
+    if (check_jobs(jobs) > 0 && interactive)
+        print_prompt();
 }
 
-void check_jobs(job_list_t *jobs) {
-    for (int i = 0; i < jobs->count; i++) {
-        int status;
-        pid_t result = waitpid(jobs->jobs[i].pid, &status, WNOHANG);
-        
-        if (result > 0) {
-            // Job completed
-            printf("[%d] + complete %s\n", jobs->jobs[i].job_num, jobs->jobs[i].command);
-            free(jobs->jobs[i].command);
-            
-            // Remove from list
-            for (int j = i; j < jobs->count - 1; j++) {
-                jobs->jobs[j] = jobs->jobs[j + 1];
-            }
-            jobs->count--;
-            i--;
-        }
-    }
+static void usage(void) {
+    fprintf(stderr, "usage: shell [-i] | shell -c command | shell script\n");
 }
 
-void add_to_history(command_history_t *history, const char *cmd) {
-    // Shift commands if at capacity
-    if (history->count == 3) {
-        free(history->commands[0]);
-        history->commands[0] = history->commands[1];
-        history->commands[1] = history->commands[2];
-        history->commands[2] = strdup(cmd);
+int main(int argc, char **argv) {
+    job_list_t jobs = {0};
+    jobs.next_job_num = 1;
+    
+    command_history_t history;
+
+    vars_init();
+    launch_init();
+
+    /* shell -c 'cmds' and shell script.sh run without a prompt or the
+     * per-line job polling; plain shell is interactive on a terminal
+     * (or with -i, e.g. to compare against script mode)
+     */
+    line_reader reader;
+    if (argc >= 2 && strcmp(argv[1], "-c") == 0) {
+        if (argc < 3) {
+            usage();
+            return 2;
+        }
+        reader_init_string(&reader, argv[2]);
+    } else if (argc >= 2 && strcmp(argv[1], "-i") != 0) {
+        int fd = open(argv[1], O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            fprintf(stderr, "%s: %s\n", argv[1], strerror(errno));
+            return 127;
+        }
+        reader_init(&reader, fd);
     } else {
-        history->commands[history->count] = strdup(cmd);
-        history->count++;
-    }
-}
-
-void display_history(command_history_t *history) {
-    if (history->count == 0) {
-        printf("No commands in history.\n");
-        return;
-    }
+        reader_init(&reader, STDIN_FILENO);
+        interactive = (argc >= 2) || isatty(STDIN_FILENO);
+    }
+
+    // Only interactive sessions share the history file
+    history_open(&history, interactive);
+    shell_t sh = { .jobs = &jobs, .history = &history, .interactive = interactive };
+    struct stat input;
+    if (reader.fd >= 0 && fstat(reader.fd, &input) == 0) {
+        sh.input_dev = input.st_dev;
+        sh.input_ino = input.st_ino;
+    }
+
+    // Children are reaped as SIGCHLD arrives, and timeouts fire, including
+    // while the prompt sits idle waiting for input
+    int events = epoll_create1(EPOLL_CLOEXEC);
+    int event_fds[2] = { jobs_init_signals(), timeout_fd() };
+    for (int i = 0; i < 2; i++) {
+        struct epoll_event ev = { .events = EPOLLIN };
+        if (event_fds[i] >= 0)
+            epoll_ctl(events, EPOLL_CTL_ADD, event_fds[i], &ev);
+    }
+    reader.notify_fd = events;
+    jobs.notify = interactive;
+    reader.on_notify = notify_jobs;
+    reader.notify_arg = &jobs;
+
+    int last_status = 0;
+    char *source = NULL;    // the command being read, over one or more lines
+    size_t source_len = 0;
+    size_t source_cap = 0;
     
-    for (int i = 0; i < history->count; i++) {
-        printf("\t%s\n", history->commands[i]);
-    }
-}
-
-void wait_for_jobs(job_list_t *jobs) {
-    while (jobs->count > 0) {
-        int status;
-        // Blocking wait on the first job
-        pid_t result = waitpid(jobs->jobs[0].pid, &status, 0);
-        
-        if (result > 0) {
-            // Job completed
-            printf("[%d] + complete %s\n", jobs->jobs[0].job_num, jobs->jobs[0].command);
-            free(jobs->jobs[0].command);
-            
-            // Remove from list
-            for (int j = 0; j < jobs->count - 1; j++) {
-                jobs->jobs[j] = jobs->jobs[j + 1];
+    while (1) {
+        if (interactive && source_len > 0) {
+            print_continuation_prompt();
+        } else if (interactive) {
+            check_jobs(&jobs);  // Report jobs that finished during the last command
+            print_prompt();
+        }
+
+        STATS_BEGIN(read_start);
+        char *input = reader_getline(&reader, NULL);
+        STATS_END(STAT_INPUT, read_start);
+        if (input == NULL) {
+            if (source_len > 0) {
+                fprintf(stderr, "syntax error: unexpected end of file\n");
+                last_status = 2;
+            }
+            // EOF (Ctrl-D or end of piped input) behaves like exit
+            if (interactive) {
+                printf("\n");
+                exit_shell(&sh);
+            }
+            break;
+        }
+        // the first line of a command may recall history
+        if (source_len == 0) {
+            static char recalled[2 * HIST_MAX_LINE];
+            input = expand_history(&history, input, recalled, sizeof(recalled));
+            if (input == NULL) {
+                last_status = 1;
+                continue;
             }
-            jobs->count--;
         }
-    }
-}
 
-bool handle_builtin(tokenlist *tokens, job_list_t *jobs, command_history_t *history, bool *should_exit) {
-    if (tokens->size == 0) {
-        return false;
-    }
-    
-    const char *cmd = tokens->items[0];
-    
-    // Handle 'exit' command
-    if (strcmp(cmd, "exit") == 0) {
-        printf("Waiting for background processes to complete...\n");
-        wait_for_jobs(jobs);
-        
-        printf("Last valid commands:\n");
-        display_history(history);
-        
-        *should_exit = true;
-        return true;
-    }
-    
-    // Handle 'cd' command
-    if (strcmp(cmd, "cd") == 0) {
-        if (tokens->size > 2) {
-            printf("cd: too many arguments\n");
-            return true;
-        }
-        
-        const char *target_dir = (tokens->size == 2) ? tokens->items[1] : getenv("HOME");
-        
-        if (target_dir == NULL) {
-            printf("cd: HOME not set\n");
-            return true;
-        }
-        
-        struct stat st;
-        if (stat(target_dir, &st) != 0) {
-            printf("cd: %s: No such file or directory\n", target_dir);
-            return true;
-        }
-        
-        if (!S_ISDIR(st.st_mode)) {
-            printf("cd: %s: Not a directory\n", target_dir);
-            return true;
-        }
-        
-        if (chdir(target_dir) != 0) {
-            perror("cd");
-            return true;
+        // A command continued over several lines is parsed as a whole
+        size_t len = strlen(input);
+        if (source_len + len + 2 > source_cap) {
+            source_cap = (source_len + len + 2) * 2;
+            source = realloc(source, source_cap);
+        }
+        if (source_len > 0)
+            source[source_len++] = '\n';
+        memcpy(source + source_len, input, len + 1);
+        source_len += len;
+
+        STATS_BEGIN(lex_start);
+        tokenlist *tokens = get_tokens(source);
+        STATS_END(STAT_TOKENIZE, lex_start);
+        STATS_BEGIN(parse_start);
+        plan_t plan;
+        parse_result parsed;
+        if (tokens->status == LEX_OPEN_QUOTE) {
+            parsed = PARSE_INCOMPLETE;  // the quoted text goes on with the next line
+        } else if (tokens->status != LEX_OK) {
+            fprintf(stderr, "syntax error\n");
+            parsed = PARSE_ERROR;
+        } else {
+            parsed = parse_plan(tokens, &plan);
         }
-        
-        return true;
-    }
-    
-    // Handle 'jobs' command
-    if (strcmp(cmd, "jobs") == 0) {
-        if (jobs->count == 0) {
-            printf("No active background processes.\n");
-            return true;
+        STATS_END(STAT_PARSE, parse_start);
+        if (parsed == PARSE_INCOMPLETE) {
+            free_tokens(tokens);
+            continue;
         }
-        
-        for (int i = 0; i < jobs->count; i++) {
-            printf("[%d]+ %d %s\n", jobs->jobs[i].job_num, jobs->jobs[i].pid, jobs->jobs[i].command);
+        source_len = 0;
+        if (parsed == PARSE_ERROR) {
+            last_status = 2;
+            free_tokens(tokens);
+            continue;
         }
-        
-        return true;
-    }
-    
-    return false;  // Not a built-in command
-}
-
-static char *expand_tilde(const char *tok)
-{
-	//Dont expand if invalid, not ~, or not ~/
-	if(!tok || tok[0]!='~' || ( tok[1]!='\0' && tok[1]!='/' ))  
-	 return strdup(tok);
-
-
-
-	const char *home=getenv("HOME");
-/*	if(!home || home[0]=='\0'){
-	 struct passwd *pw =getpwuid(getuid());
-	 if (pw) home = pw->pw_dir; }*/
-
-        if(!home || home[0]=='\0') //Unable to expand
-	 return strdup(tok);
 
-       const char *rest = (tok[1] =='/') ? (tok+1) : ""; //Check if  ~/ or ~
-	size_t length=strlen(home) + strlen(rest) +1;
-	char *out=malloc(length);
-	if(!out) return strdup(tok);  //Not enough space
+        sh.found_command = false;
+        last_status = run_plan(&sh, &plan, 0, plan.size, last_status);
 
-	strcpy(out,home);
-	strcat(out,rest);
-	return out;}
+        // Recorded only if it ran a command that exists
+        if (sh.found_command && !sh.should_exit)
+            add_to_history(&history, source);
 
-int main(void) {
-    job_list_t jobs = {0};
-    jobs.next_job_num = 1;
-    
-    command_history_t history = {0};
-    
-    while (1) {
-        check_jobs(&jobs);  // Check for completed background jobs
-        
-        print_prompt();
-        char *input = get_input();
-
-        tokenlist *tokens = get_tokens(input);
-        expand_tokens(tokens);
-
-        // Check for background execution
-        bool is_background = false;
-        if (tokens->size > 0 && strcmp(tokens->items[tokens->size - 1], "&") == 0) {
-            is_background = true;
-            free(tokens->items[tokens->size - 1]);
-            tokens->size--;
-        }
-
-        if (tokens->size > 0) {
-            // Record command to history before checking if it's valid
-            char cmd_str[200] = "";
-            for (size_t i = 0; i < tokens->size; i++) {
-                strncat(cmd_str, tokens->items[i], sizeof(cmd_str) - strlen(cmd_str) - 1);
-                if (i < tokens->size - 1) {
-                    strncat(cmd_str, " ", sizeof(cmd_str) - strlen(cmd_str) - 1);
-                }
-            }
-            if (is_background) {
-                strncat(cmd_str, " &", sizeof(cmd_str) - strlen(cmd_str) - 1);
-            }
-            
-            // Check for built-in commands first
-            bool should_exit = false;
-            if (!handle_builtin(tokens, &jobs, &history, &should_exit)) {
-                // Not a built-in, try external command
-                char *cmd_path = search_path(tokens->items[0]);
-                if (cmd_path != NULL) {
-                    // Add to history only if it's a valid command
-                    add_to_history(&history, cmd_str);
-                    execute_command(cmd_path, tokens, is_background, &jobs);
-                    free(cmd_path);
-                } else {
-                    printf("%s: command not found\n", tokens->items[0]);
-                }
-            } else if (!should_exit) {
-                // Built-in command executed (but not exit)
-                add_to_history(&history, cmd_str);
-            }
-            
-            if (should_exit) {
-                free(input);
-                free_tokens(tokens);
-                break;
-            }
-        }
-
-        free(input);
+        free_plan(&plan);
         free_tokens(tokens);
+        if (sh.should_exit)
+            break;
     }
     
-    // Clean up history
-    for (int i = 0; i < history.count; i++) {
-        free(history.commands[i]);
-    }
+    free(source);
+    history_close(&history);
+    reader_free(&reader);
+    close(events);
+    free_jobs(&jobs);
 
-    return 0;
+    return last_status;
 }
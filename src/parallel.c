@@ -0,0 +1,238 @@
+#define _GNU_SOURCE
+
+#include "parallel.h"
+#include "launch.h"
+#include "lexer.h"
+#include "path.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+
+typedef struct {
+    job_t *job;         // NULL when the slot is free
+    int out_fd;         // memfd collecting the job's stdout
+    int err_fd;         // ... and its stderr
+    char **argv;        // argv with the value substituted (malloc'd)
+} slot_t;
+
+typedef struct {
+    char **values;      // values after :::, or NULL to read stdin
+    int nvalues;
+    int next;
+    line_reader stdin_reader;
+} value_source;
+
+static const char *next_value(value_source *src)
+{
+    if (src->values != NULL)
+        return src->next < src->nvalues ? src->values[src->next++] : NULL;
+    return reader_getline(&src->stdin_reader, NULL);
+}
+
+// Copies `word` with every "{}" replaced by `value`
+static char *substitute(const char *word, const char *value)
+{
+    size_t vlen = strlen(value);
+    size_t len = strlen(word) + 1;
+    for (const char *p = strstr(word, "{}"); p; p = strstr(p + 2, "{}"))
+        len += vlen;
+
+    char *out = malloc(len);
+    char *o = out;
+    const char *p;
+    while ((p = strstr(word, "{}")) != NULL) {
+        memcpy(o, word, p - word);
+        o += p - word;
+        memcpy(o, value, vlen);
+        o += vlen;
+        word = p + 2;
+    }
+    strcpy(o, word);
+    return out;
+}
+
+static char **build_argv(char **template, int n, bool append, const char *value)
+{
+    char **argv = malloc((n + 2) * sizeof(char *));
+    for (int i = 0; i < n; i++)
+        argv[i] = substitute(template[i], value);
+    argv[n] = append ? strdup(value) : NULL;
+    argv[n + 1] = NULL;
+    return argv;
+}
+
+static void free_argv(char **argv)
+{
+    for (int i = 0; argv[i] != NULL; i++)
+        free(argv[i]);
+    free(argv);
+}
+
+// Writes everything a job produced into `from` to `to` in one go
+static void flush_output(int from, int to)
+{
+    off_t size = lseek(from, 0, SEEK_END);
+    off_t off = 0;
+    while (off < size) {
+        ssize_t n = sendfile(to, from, &off, size - off);
+        if (n > 0)
+            continue;
+
+        // sendfile refused the target: fall back to read/write
+        char buf[65536];
+        lseek(from, off, SEEK_SET);
+        while ((n = read(from, buf, sizeof(buf))) > 0)
+            if (write(to, buf, n) < 0)
+                return;
+        return;
+    }
+}
+
+static void start_job(slot_t *slot, char **argv, int devnull, job_list_t *jobs, int *failed)
+{
+    char *cmd_path = search_path(argv[0]);
+    if (cmd_path == NULL) {
+        fprintf(stderr, "%s: command not found\n", argv[0]);
+        (*failed)++;
+        free_argv(argv);
+        return;
+    }
+
+    int out_fd = memfd_create("parallel-stdout", MFD_CLOEXEC);
+    int err_fd = memfd_create("parallel-stderr", MFD_CLOEXEC);
+    launch_t l = { cmd_path, argv, devnull, out_fd, err_fd, NULL };
+    pid_t pid = launch(&l);
+    free(cmd_path);
+
+    if (pid < 0) {
+        (*failed)++;
+        close(out_fd);
+        close(err_fd);
+        free_argv(argv);
+        return;
+    }
+
+    char cmd_str[1024] = "";
+    for (int i = 0; argv[i] != NULL; i++) {
+        if (i > 0)
+            strncat(cmd_str, " ", sizeof(cmd_str) - strlen(cmd_str) - 1);
+        strncat(cmd_str, argv[i], sizeof(cmd_str) - strlen(cmd_str) - 1);
+    }
+
+    // Tracked in the job table so background jobs finishing meanwhile are
+    // still reaped and reported normally
+    slot->job = add_job(jobs, &pid, 1, cmd_str);
+    slot->job->quiet = true;
+    slot->out_fd = out_fd;
+    slot->err_fd = err_fd;
+    slot->argv = argv;
+}
+
+int parallel_builtin(int argc, char **argv, job_list_t *jobs, bool read_stdin) {
+    long njobs = sysconf(_SC_NPROCESSORS_ONLN);
+    int i = 1;
+
+    if (i < argc && strncmp(argv[i], "-j", 2) == 0) {
+        const char *n = argv[i][2] ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : "");
+        njobs = atol(n);
+        if (njobs < 1) {
+            fprintf(stderr, "parallel: -j: expected a positive number\n");
+            return 2;
+        }
+        i++;
+    }
+
+    int cmd_start = i;
+    int cmd_end = i;
+    while (cmd_end < argc && strcmp(argv[cmd_end], ":::") != 0)
+        cmd_end++;
+    if (cmd_start == cmd_end) {
+        fprintf(stderr, "usage: parallel [-j N] cmd [arg...] [::: value...]\n");
+        return 2;
+    }
+
+    // Without {} the value becomes the last argument
+    bool append = true;
+    for (int a = cmd_start; a < cmd_end; a++)
+        if (strstr(argv[a], "{}") != NULL)
+            append = false;
+
+    value_source src = { 0 };
+    if (cmd_end == argc && !read_stdin) {
+        fprintf(stderr, "parallel: stdin is the shell's script; give the values after :::\n");
+        return 2;
+    }
+    if (cmd_end < argc) {
+        src.values = &argv[cmd_end + 1];
+        src.nvalues = argc - cmd_end - 1;
+    } else {
+        reader_init(&src.stdin_reader, STDIN_FILENO);
+    }
+
+    // Jobs share no input; concurrent readers of a terminal would fight
+    int devnull = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    slot_t *slots = calloc(njobs, sizeof(slot_t));
+    int running = 0;
+    int failed = 0;
+    bool more = true;
+
+    fflush(stdout);
+    while (more || running > 0) {
+        // Fill every free slot before waiting
+        for (long s = 0; more && s < njobs; s++) {
+            if (slots[s].job != NULL)
+                continue;
+            const char *value = next_value(&src);
+            if (value == NULL) {
+                more = false;
+                break;
+            }
+            char **job_argv = build_argv(&argv[cmd_start], cmd_end - cmd_start, append, value);
+            start_job(&slots[s], job_argv, devnull, jobs, &failed);
+            if (slots[s].job != NULL)
+                running++;
+            else
+                s--;    // retry this slot with the next value
+        }
+        if (running == 0)
+            break;
+
+        job_t *job = wait_any_job(jobs);
+        if (job == NULL)
+            break;
+        if (!job->quiet) {
+            finish_job(jobs, job);     // an ordinary background job
+            continue;
+        }
+
+        for (long s = 0; s < njobs; s++) {
+            slot_t *slot = &slots[s];
+            if (slot->job != job)
+                continue;
+            flush_output(slot->out_fd, STDOUT_FILENO);
+            flush_output(slot->err_fd, STDERR_FILENO);
+            close(slot->out_fd);
+            close(slot->err_fd);
+            free_argv(slot->argv);
+            slot->job = NULL;
+            break;
+        }
+        if (job->status != 0)
+            failed++;
+        remove_job(jobs, job);
+        running--;
+    }
+
+    free(slots);
+    close(devnull);
+    if (src.values == NULL)
+        reader_free(&src.stdin_reader);
+
+    // Like GNU parallel: the number of failed jobs, capped at 101
+    return failed > 101 ? 101 : failed;
+}
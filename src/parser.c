@@ -0,0 +1,439 @@
+#include "parser.h"
+#include "vars.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Recursive descent over the token array. Each construct emits its nodes
+ * as it is recognised; forward jumps are patched once their target is
+ * known. Node indexes (not pointers) are kept, as the array may move.
+ */
+typedef struct {
+    char **tok;
+    size_t n;
+    size_t pos;
+    plan_t *plan;
+    bool failed;
+    bool incomplete;    // failed at the end of the input
+} parser;
+
+static const char *peek(parser *p)
+{
+    return p->pos < p->n ? p->tok[p->pos] : NULL;
+}
+
+static bool is_word(const char *tok, const char *word)
+{
+    return tok != NULL && !is_any_operator(tok) && strcmp(tok, word) == 0;
+}
+
+// Reserved words that cannot start a simple command
+static bool is_reserved(const char *tok)
+{
+    static const char *const reserved[] = {
+        "if", "then", "elif", "else", "fi", "for", "do", "done",
+        "while", "until", "{", "}", NULL
+    };
+    for (const char *const *r = reserved; *r != NULL; r++)
+        if (is_word(tok, *r))
+            return true;
+    return false;
+}
+
+static bool syntax_error(parser *p, const char *tok)
+{
+    if (!p->failed) {
+        if (tok == NULL)
+            p->incomplete = true;
+        else
+            fprintf(stderr, "syntax error near unexpected token `%s'\n",
+                    strcmp(tok, "\n") == 0 ? "newline" : tok);
+    }
+    p->failed = true;
+    return false;
+}
+
+static bool unsupported(parser *p, const char *what)
+{
+    if (!p->failed)
+        fprintf(stderr, "syntax error: %s are not supported\n", what);
+    p->failed = true;
+    return false;
+}
+
+static size_t emit(parser *p, plan_op op)
+{
+    plan_t *plan = p->plan;
+    if (plan->size == plan->cap) {
+        plan->cap = plan->cap ? plan->cap * 2 : 16;
+        plan->nodes = realloc(plan->nodes, plan->cap * sizeof(plan_node));
+    }
+    plan->nodes[plan->size] = (plan_node){ .op = op };
+    return plan->size++;
+}
+
+static void skip_newlines(parser *p)
+{
+    while (p->pos < p->n && is_operator(p->tok[p->pos], "\n"))
+        p->pos++;
+}
+
+static bool expect(parser *p, const char *word)
+{
+    const char *t = peek(p);
+    if (is_word(t, word) || (t != NULL && is_operator(t, word))) {
+        p->pos++;
+        return true;
+    }
+    return syntax_error(p, t);
+}
+
+static bool parse_list(parser *p, const char *const *stops);
+
+// Words and < > redirections up to the next operator
+static bool parse_simple(parser *p)
+{
+    size_t start = p->pos;
+    const char *t;
+    while ((t = peek(p)) != NULL) {
+        if (is_operator(t, "<") || is_operator(t, ">")) {
+            if (p->pos + 1 == p->n)
+                return syntax_error(p, "\n");
+            if (is_any_operator(p->tok[p->pos + 1]))
+                return syntax_error(p, p->tok[p->pos + 1]);
+            p->pos += 2;
+            continue;
+        }
+        if (is_any_operator(t))
+            break;
+        p->pos++;
+    }
+    if (p->pos == start)
+        return syntax_error(p, t);
+    return true;
+}
+
+static void redirections(parser *p, plan_node *node)
+{
+    node->first = p->pos;
+    while (p->pos + 1 < p->n && (is_operator(p->tok[p->pos], "<") || is_operator(p->tok[p->pos], ">"))
+           && !is_any_operator(p->tok[p->pos + 1]))
+        p->pos += 2;
+    node->count = p->pos - node->first;
+}
+
+static bool parse_if(parser *p)
+{
+    static const char *const then_stops[] = { "then", NULL };
+    static const char *const body_stops[] = { "elif", "else", "fi", NULL };
+    static const char *const else_stops[] = { "fi", NULL };
+    size_t to_end = SIZE_MAX;   // JUMPs to the end, chained through target
+
+    p->pos++;
+    while (1) {
+        if (!parse_list(p, then_stops) || !expect(p, "then"))
+            return false;
+        size_t branch = emit(p, PLAN_BRANCH);
+        if (!parse_list(p, body_stops))
+            return false;
+
+        const char *t = peek(p);
+        bool more = is_word(t, "elif") || is_word(t, "else");
+        if (more) {
+            size_t jump = emit(p, PLAN_JUMP);
+            p->plan->nodes[jump].target = to_end;
+            to_end = jump;
+        }
+        p->plan->nodes[branch].target = p->plan->size;
+
+        if (is_word(t, "elif")) {
+            p->pos++;
+            continue;
+        }
+        if (is_word(t, "else")) {
+            p->pos++;
+            if (!parse_list(p, else_stops))
+                return false;
+        }
+        if (!expect(p, "fi"))
+            return false;
+        break;
+    }
+
+    while (to_end != SIZE_MAX) {
+        size_t next = p->plan->nodes[to_end].target;
+        p->plan->nodes[to_end].target = p->plan->size;
+        to_end = next;
+    }
+    return true;
+}
+
+static bool parse_loop_body(parser *p, size_t loop, size_t test, size_t again)
+{
+    static const char *const done_stops[] = { "done", NULL };
+    if (!expect(p, "do") || !parse_list(p, done_stops) || !expect(p, "done"))
+        return false;
+
+    size_t save = emit(p, PLAN_SAVE);
+    size_t jump = emit(p, PLAN_JUMP);
+    plan_node *nodes = p->plan->nodes;
+    nodes[save].target = test;
+    nodes[jump].target = again;
+    nodes[loop].target = test;
+    nodes[test].target = p->plan->size;
+    return true;
+}
+
+static bool parse_while(parser *p)
+{
+    static const char *const do_stops[] = { "do", NULL };
+    bool until = is_word(peek(p), "until");
+
+    p->pos++;
+    size_t loop = emit(p, PLAN_LOOP);
+    size_t cond = p->plan->size;
+    if (!parse_list(p, do_stops))
+        return false;
+    size_t branch = emit(p, PLAN_BRANCH);
+    p->plan->nodes[branch].negate = until;
+    return parse_loop_body(p, loop, branch, cond);
+}
+
+static bool parse_for(parser *p)
+{
+    p->pos++;
+    const char *name = peek(p);
+    if (name == NULL || is_any_operator(name) || !is_valid_name(name))
+        return syntax_error(p, name);
+    p->pos++;
+    skip_newlines(p);
+
+    // for NAME [in word...] ; do
+    size_t first = p->pos;
+    if (is_word(peek(p), "in")) {
+        first = ++p->pos;
+        while (p->pos < p->n && !is_any_operator(p->tok[p->pos]))
+            p->pos++;
+    }
+    size_t count = p->pos - first;
+    const char *t = peek(p);
+    if (t != NULL && (is_operator(t, ";") || is_operator(t, "\n")))
+        p->pos++;
+    else if (count > 0 || !is_word(t, "do"))
+        return syntax_error(p, t);
+    skip_newlines(p);
+
+    size_t loop = emit(p, PLAN_LOOP);
+    size_t next = emit(p, PLAN_FOR);
+    plan_node *node = &p->plan->nodes[next];
+    node->name = name;
+    node->first = first;
+    node->count = count;
+    return parse_loop_body(p, loop, next, next);
+}
+
+static bool parse_compound(parser *p)
+{
+    const char *t = peek(p);
+    if (is_operator(t, "(")) {
+        size_t sub = emit(p, PLAN_SUBSHELL);
+        p->plan->nodes[sub].source = p->pos++;
+        if (!parse_list(p, NULL) || !expect(p, ")"))
+            return false;
+        p->plan->nodes[sub].target = p->plan->size;
+        redirections(p, &p->plan->nodes[sub]);
+        return true;
+    }
+    if (is_word(t, "{")) {
+        static const char *const group_stops[] = { "}", NULL };
+        p->pos++;
+        return parse_list(p, group_stops) && expect(p, "}");
+    }
+    if (is_word(t, "if"))
+        return parse_if(p);
+    if (is_word(t, "for"))
+        return parse_for(p);
+    return parse_while(p);
+}
+
+static bool starts_compound(const char *t)
+{
+    return is_operator(t, "(") || is_word(t, "{") || is_word(t, "if")
+        || is_word(t, "for") || is_word(t, "while") || is_word(t, "until");
+}
+
+// [!] [time] command [| command]...
+static bool parse_pipeline(parser *p)
+{
+    bool negate = false;
+    bool timed = false;
+    if (is_word(peek(p), "!")) {
+        negate = true;
+        p->pos++;
+    }
+    if (is_word(peek(p), "time") && p->pos + 1 < p->n
+        && (!is_any_operator(p->tok[p->pos + 1]) || is_operator(p->tok[p->pos + 1], "("))) {
+        timed = true;
+        p->pos++;
+    }
+
+    const char *t = peek(p);
+    if (starts_compound(t)) {
+        size_t start = p->plan->size;
+        if (!parse_compound(p))
+            return false;
+        plan_node *node = &p->plan->nodes[start];
+        if (node->op == PLAN_SUBSHELL) {
+            node->negate = negate;
+            node->timed = timed;
+        } else if (negate || timed) {
+            return unsupported(p, "! and time before { }, if and loops");
+        }
+        t = peek(p);
+        if (t != NULL && is_operator(t, "|"))
+            return unsupported(p, "compound commands in pipelines");
+        if (t != NULL && (is_operator(t, "<") || is_operator(t, ">"))) {
+            if (node->op == PLAN_SUBSHELL)
+                return syntax_error(p, p->pos + 1 < p->n ? p->tok[p->pos + 1] : "\n");
+            return unsupported(p, "redirections of { }, if and loops");
+        }
+        return true;
+    }
+    if (t != NULL && is_reserved(t))
+        return syntax_error(p, t);
+
+    size_t first = p->pos;
+    while (1) {
+        if (!parse_simple(p))
+            return false;
+        if (!is_operator(peek(p), "|"))
+            break;
+        p->pos++;
+        skip_newlines(p);
+        t = peek(p);
+        if (starts_compound(t))
+            return unsupported(p, "compound commands in pipelines");
+        if (t != NULL && is_reserved(t))
+            return syntax_error(p, t);
+    }
+
+    size_t i = emit(p, PLAN_PIPELINE);
+    plan_node *node = &p->plan->nodes[i];
+    node->first = first;
+    node->count = p->pos - first;
+    node->negate = negate;
+    node->timed = timed;
+    return true;
+}
+
+// pipeline [&& pipeline | || pipeline]...
+static bool parse_and_or(parser *p)
+{
+    if (!parse_pipeline(p))
+        return false;
+    const char *t;
+    while ((t = peek(p)) != NULL && (is_operator(t, "&&") || is_operator(t, "||"))) {
+        p->pos++;
+        size_t skip = emit(p, is_operator(t, "&&") ? PLAN_AND : PLAN_OR);
+        skip_newlines(p);
+        if (!parse_pipeline(p))
+            return false;
+        p->plan->nodes[skip].target = p->plan->size;
+    }
+    return true;
+}
+
+/**
+ * `list &` runs in the background: a lone pipeline or subshell is marked
+ * as such, anything else is wrapped in a background subshell inserted
+ * in front of its nodes.
+ */
+static void background(parser *p, size_t start, size_t source)
+{
+    plan_t *plan = p->plan;
+    plan_node *first = &plan->nodes[start];
+    if ((first->op == PLAN_PIPELINE && plan->size == start + 1)
+        || (first->op == PLAN_SUBSHELL && first->target == plan->size)) {
+        first->background = true;
+        return;
+    }
+
+    emit(p, PLAN_SUBSHELL);
+    memmove(&plan->nodes[start + 1], &plan->nodes[start],
+            (plan->size - start - 1) * sizeof(plan_node));
+    for (size_t i = start + 1; i < plan->size; i++)
+        if (plan->nodes[i].op != PLAN_PIPELINE && plan->nodes[i].target > start)
+            plan->nodes[i].target++;
+    plan->nodes[start] = (plan_node){ .op = PLAN_SUBSHELL, .background = true,
+                                      .target = plan->size, .source = source,
+                                      .first = p->pos };
+}
+
+static bool at_stop(const char *t, const char *const *stops)
+{
+    if (is_operator(t, ")"))
+        return true;
+    for (; stops != NULL && *stops != NULL; stops++)
+        if (is_word(t, *stops))
+            return true;
+    return false;
+}
+
+/**
+ * and_or [; | & | newline and_or]... up to one of the stop words (or a
+ * closing parenthesis), which is left for the caller. Must not be empty.
+ */
+static bool parse_list(parser *p, const char *const *stops)
+{
+    bool any = false;
+    skip_newlines(p);
+    while (1) {
+        const char *t = peek(p);
+        if (t == NULL || at_stop(t, stops))
+            break;
+        size_t start = p->plan->size;
+        size_t source = p->pos;
+        if (!parse_and_or(p))
+            return false;
+        any = true;
+
+        t = peek(p);
+        if (t == NULL)
+            break;
+        if (is_operator(t, "&"))
+            background(p, start, source);
+        else if (!is_operator(t, ";") && !is_operator(t, "\n"))
+            break;
+        p->pos++;
+        skip_newlines(p);
+    }
+    return any || syntax_error(p, peek(p));
+}
+
+parse_result parse_plan(tokenlist *tokens, plan_t *plan)
+{
+    *plan = (plan_t){ .words = tokens->items };
+    parser p = { tokens->items, tokens->size, 0, plan, false, false };
+
+    skip_newlines(&p);
+    if (peek(&p) != NULL && parse_list(&p, NULL) && peek(&p) != NULL)
+        syntax_error(&p, peek(&p));
+
+    if (p.failed) {
+        free_plan(plan);
+        return p.incomplete ? PARSE_INCOMPLETE : PARSE_ERROR;
+    }
+    return PARSE_OK;
+}
+
+void free_plan(plan_t *plan)
+{
+    for (size_t i = 0; i < plan->size; i++)
+        if (plan->nodes[i].values != NULL)
+            free_tokens(plan->nodes[i].values);
+    free(plan->nodes);
+    plan->nodes = NULL;
+    plan->size = plan->cap = 0;
+}
@@ -0,0 +1,330 @@
+#include "path.h"
+#include "pathindex.h"
+#include "vars.h"
+#include "stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/stat.h>
+
+// How often the PATH directories are re-stat'ed for mtime changes
+#define PATH_RECHECK_NS 1000000000LL
+
+typedef struct path_entry {
+    char *name;                 // command name as typed
+    char *path;                 // resolved path, NULL if not found
+    size_t dir;                 // PATH index it resolved in (ndirs if not found)
+    unsigned hits;
+    struct path_entry *next;    // bucket chain
+} path_entry;
+
+typedef struct {
+    char *name;
+    struct timespec mtime;
+    bool exists;
+    int index;                  // path_index_dir() handle
+    unsigned index_gen;         // its generation when entries were last trusted
+} path_dir;
+
+static struct {
+    path_entry **buckets;
+    size_t nbuckets;
+    size_t count;
+
+    char *path_env;             // PATH the cache was built against
+    unsigned long vars_gen;     // vars_generation() when PATH was compared
+    path_dir *dirs;
+    size_t ndirs;
+    struct timespec checked;    // last time dir mtimes were verified
+} cache;
+
+static unsigned long hash_name(const char *s)
+{
+    // FNV-1a
+    unsigned long h = 2166136261UL;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619UL;
+    }
+    return h;
+}
+
+static void stat_dir(path_dir *d)
+{
+    struct stat st;
+    d->exists = (stat(d->name, &st) == 0 && S_ISDIR(st.st_mode));
+    if (d->exists)
+        d->mtime = st.st_mtim;
+}
+
+/**
+ * Drops every entry that resolved in PATH directory `first` or later.
+ * A change to directory k can only shadow or remove commands found in k or
+ * after it, plus any "not found" results (stored with dir == ndirs).
+ */
+static void flush_from(size_t first)
+{
+    for (size_t b = 0; b < cache.nbuckets; b++) {
+        path_entry **link = &cache.buckets[b];
+        while (*link) {
+            path_entry *e = *link;
+            if (e->dir >= first) {
+                *link = e->next;
+                free(e->name);
+                free(e->path);
+                free(e);
+                cache.count--;
+            } else {
+                link = &e->next;
+            }
+        }
+    }
+}
+
+static void free_dirs(void)
+{
+    for (size_t i = 0; i < cache.ndirs; i++)
+        free(cache.dirs[i].name);
+    free(cache.dirs);
+    free(cache.path_env);
+    cache.dirs = NULL;
+    cache.ndirs = 0;
+    cache.path_env = NULL;
+}
+
+// Splits PATH once; lookups then walk this array instead of strtok'ing
+static void load_dirs(const char *path_env)
+{
+    free_dirs();
+    cache.path_env = strdup(path_env);
+
+    size_t n = 1;
+    for (const char *p = path_env; *p; p++)
+        if (*p == ':')
+            n++;
+    cache.dirs = calloc(n, sizeof(path_dir));
+
+    const char *start = path_env;
+    while (1) {
+        const char *end = strchr(start, ':');
+        size_t len = end ? (size_t)(end - start) : strlen(start);
+        if (len > 0) {  // empty components are skipped, as before
+            path_dir *d = &cache.dirs[cache.ndirs++];
+            d->name = strndup(start, len);
+            d->index = path_index_dir(d->name);
+            d->index_gen = path_index_generation(d->index);
+            stat_dir(d);
+        }
+        if (!end)
+            break;
+        start = end + 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &cache.checked);
+}
+
+/**
+ * Makes sure cached entries still describe the current PATH.
+ * Comparing the PATH string costs no syscalls; directory mtimes are only
+ * re-checked once per PATH_RECHECK_NS so a pipeline or a tight script loop
+ * does not pay a stat() per directory for every command.
+ */
+static void sync_cache(const char *path_env)
+{
+    // PATH can only have changed if some variable has
+    bool changed = cache.path_env == NULL ||
+                   (cache.vars_gen != vars_generation() && strcmp(cache.path_env, path_env) != 0);
+    cache.vars_gen = vars_generation();
+    if (changed) {
+        flush_from(0);
+        load_dirs(path_env);
+        return;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    long long elapsed = (now.tv_sec - cache.checked.tv_sec) * 1000000000LL
+                      + (now.tv_nsec - cache.checked.tv_nsec);
+    if (elapsed < PATH_RECHECK_NS)
+        return;
+    cache.checked = now;
+
+    for (size_t i = 0; i < cache.ndirs; i++) {
+        path_dir *d = &cache.dirs[i];
+        path_dir old = *d;
+        stat_dir(d);
+        if (d->exists != old.exists ||
+            (d->exists && (d->mtime.tv_sec != old.mtime.tv_sec ||
+                           d->mtime.tv_nsec != old.mtime.tv_nsec))) {
+            flush_from(i);
+            // Later directories are rechecked on the next pass; the entries
+            // that depended on them are already gone.
+            for (size_t j = i + 1; j < cache.ndirs; j++)
+                stat_dir(&cache.dirs[j]);
+            return;
+        }
+    }
+}
+
+/**
+ * Flushes the entries inotify reports out of date. That costs one read()
+ * for all directories, so it runs before any "not found" answer instead
+ * of waiting for the mtime recheck.
+ * Returns true if anything was flushed.
+ */
+static bool poll_index(void)
+{
+    if (!path_index_poll())
+        return false;
+
+    for (size_t i = 0; i < cache.ndirs; i++) {
+        path_dir *d = &cache.dirs[i];
+        if (path_index_generation(d->index) == d->index_gen)
+            continue;
+        flush_from(i);
+        for (size_t j = i; j < cache.ndirs; j++) {
+            cache.dirs[j].index_gen = path_index_generation(cache.dirs[j].index);
+            stat_dir(&cache.dirs[j]);
+        }
+        return true;
+    }
+    return false;
+}
+
+static void grow_table(void)
+{
+    size_t nbuckets = cache.nbuckets ? cache.nbuckets * 2 : 64;
+    path_entry **buckets = calloc(nbuckets, sizeof(path_entry *));
+
+    for (size_t b = 0; b < cache.nbuckets; b++) {
+        path_entry *e = cache.buckets[b];
+        while (e) {
+            path_entry *next = e->next;
+            size_t slot = hash_name(e->name) & (nbuckets - 1);
+            e->next = buckets[slot];
+            buckets[slot] = e;
+            e = next;
+        }
+    }
+    free(cache.buckets);
+    cache.buckets = buckets;
+    cache.nbuckets = nbuckets;
+}
+
+static path_entry *resolve(const char *command)
+{
+    path_entry *e = malloc(sizeof(path_entry));
+    e->name = strdup(command);
+    e->path = NULL;
+    e->dir = cache.ndirs;
+    e->hits = 0;
+
+    for (size_t i = 0; i < cache.ndirs; i++) {
+        if (!cache.dirs[i].exists)
+            continue;
+        // the index rules most directories out without a syscall
+        if (path_index_lists(cache.dirs[i].index, command) == 0)
+            continue;
+
+        // Build full path: dir + "/" + command
+        char full_path[PATH_MAX];
+        snprintf(full_path, sizeof(full_path), "%s/%s", cache.dirs[i].name, command);
+
+        // Check if file exists and is executable
+        if (access(full_path, X_OK) == 0) {
+            e->path = strdup(full_path);
+            e->dir = i;
+            break;
+        }
+    }
+
+    if (cache.count + 1 > cache.nbuckets)
+        grow_table();
+    size_t slot = hash_name(command) & (cache.nbuckets - 1);
+    e->next = cache.buckets[slot];
+    cache.buckets[slot] = e;
+    cache.count++;
+    return e;
+}
+
+static path_entry *find_entry(const char *command)
+{
+    if (cache.nbuckets == 0)
+        return NULL;
+    path_entry *e = cache.buckets[hash_name(command) & (cache.nbuckets - 1)];
+    while (e && strcmp(e->name, command) != 0)
+        e = e->next;
+    return e;
+}
+
+static char *lookup(const char *command) {
+    // If command contains '/', don't search PATH
+    if (strchr(command, '/') != NULL) {
+        if (access(command, X_OK) == 0) {
+            return strdup(command);
+        }
+        return NULL;
+    }
+
+    const char *path_env = vars_get("PATH");
+    if (path_env == NULL) {
+        return NULL;
+    }
+    sync_cache(path_env);
+
+    path_entry *e = find_entry(command);
+    if ((e == NULL || e->path == NULL) && poll_index())
+        e = find_entry(command);
+    if (e == NULL)
+        e = resolve(command);
+
+    e->hits++;
+    return e->path ? strdup(e->path) : NULL;
+}
+
+char *search_path(const char *command) {
+    STATS_BEGIN(t);
+    char *path = lookup(command);
+    STATS_END(STAT_PATH, t);
+    return path;
+}
+
+void path_complete(const char *prefix, void (*fn)(const char *name, void *arg), void *arg)
+{
+    const char *path_env = vars_get("PATH");
+    if (path_env == NULL)
+        return;
+    sync_cache(path_env);
+    poll_index();
+
+    for (size_t i = 0; i < cache.ndirs; i++)
+        if (cache.dirs[i].exists)
+            path_index_complete(cache.dirs[i].index, prefix, fn, arg);
+}
+
+void path_cache_clear(void)
+{
+    flush_from(0);
+    free_dirs();
+}
+
+void path_cache_print(void)
+{
+    if (cache.count == 0) {
+        printf("hash: hash table empty\n");
+        return;
+    }
+
+    printf("hits\tcommand\n");
+    for (size_t b = 0; b < cache.nbuckets; b++) {
+        for (path_entry *e = cache.buckets[b]; e; e = e->next) {
+            if (e->path)
+                printf("%4u\t%s\n", e->hits, e->path);
+            else
+                printf("%4u\t%s (not found)\n", e->hits, e->name);
+        }
+    }
+}
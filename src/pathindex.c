@@ -0,0 +1,259 @@
+#define _GNU_SOURCE
+
+#include "pathindex.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+// Everything that can change which commands a directory provides
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | \
+                    IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+typedef struct {
+    const char *name;       // in the directory's strings
+    signed char exec;       // 1 or 0 once checked, -1 before
+} index_entry;
+
+typedef struct {
+    char *path;
+    int wd;                 // inotify watch, -1 if none
+    unsigned gen;
+    bool listed;            // entries are the directory's current contents
+    index_entry *entries;   // sorted by name
+    size_t count;
+    char *strings;
+} index_dir;
+
+static struct {
+    int fd;                 // inotify instance, -1 until first needed
+    pid_t owner;            // the process that reads its events
+    bool failed;            // inotify is unavailable
+    index_dir *dirs;
+    size_t count;
+} idx = { .fd = -1 };
+
+int path_index_dir(const char *dir)
+{
+    for (size_t i = 0; i < idx.count; i++)
+        if (strcmp(idx.dirs[i].path, dir) == 0)
+            return i;
+
+    idx.dirs = realloc(idx.dirs, (idx.count + 1) * sizeof(index_dir));
+    idx.dirs[idx.count] = (index_dir){ .path = strdup(dir), .wd = -1 };
+    return idx.count++;
+}
+
+unsigned path_index_generation(int dir)
+{
+    return idx.dirs[dir].gen;
+}
+
+static void forget(index_dir *d)
+{
+    free(d->entries);
+    free(d->strings);
+    d->entries = NULL;
+    d->strings = NULL;
+    d->count = 0;
+    d->listed = false;
+}
+
+/**
+ * A forked child shares the shell's inotify instance, and the events it
+ * read would never reach the shell. It starts over with its own instead.
+ */
+static void adopt(void)
+{
+    if (idx.fd < 0 || getpid() == idx.owner)
+        return;
+    close(idx.fd);
+    idx.fd = -1;
+    for (size_t i = 0; i < idx.count; i++) {
+        idx.dirs[i].wd = -1;
+        forget(&idx.dirs[i]);
+    }
+}
+
+static bool watch(index_dir *d)
+{
+    adopt();
+    if (d->wd >= 0)
+        return true;
+    if (idx.failed)
+        return false;
+    if (idx.fd < 0) {
+        idx.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (idx.fd < 0) {
+            idx.failed = true;
+            return false;
+        }
+        idx.owner = getpid();
+    }
+    d->wd = inotify_add_watch(idx.fd, d->path, WATCH_MASK);
+    return d->wd >= 0;
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+    return strcmp(((const index_entry *)a)->name, ((const index_entry *)b)->name);
+}
+
+// One pass over the directory: every name but subdirectories
+static bool read_dir(index_dir *d)
+{
+    forget(d);
+    DIR *dir = opendir(d->path);
+    if (dir == NULL)
+        return false;
+
+    size_t *offsets = NULL;
+    size_t count = 0, cap = 0;
+    size_t used = 0, size = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_type == DT_DIR || strcmp(ent->d_name, ".") == 0 ||
+            strcmp(ent->d_name, "..") == 0)
+            continue;
+        size_t len = strlen(ent->d_name) + 1;
+        if (used + len > size) {
+            size = size ? size * 2 : 16384;
+            if (size < used + len)
+                size = used + len;
+            d->strings = realloc(d->strings, size);
+        }
+        if (count == cap) {
+            cap = cap ? cap * 2 : 256;
+            offsets = realloc(offsets, cap * sizeof(size_t));
+        }
+        memcpy(d->strings + used, ent->d_name, len);
+        offsets[count++] = used;
+        used += len;
+    }
+    closedir(dir);
+
+    // the strings moved while growing, so names are only pointed at now
+    d->entries = malloc((count ? count : 1) * sizeof(index_entry));
+    for (size_t i = 0; i < count; i++)
+        d->entries[i] = (index_entry){ d->strings + offsets[i], -1 };
+    d->count = count;
+    free(offsets);
+    qsort(d->entries, count, sizeof(index_entry), compare_entries);
+    return true;
+}
+
+// Makes d's entries current; false if they cannot be kept current
+static bool ensure_listed(index_dir *d)
+{
+    if (d->listed)
+        return true;
+    // watch before reading: a change during the read is reported
+    if (!watch(d))
+        return false;
+    d->listed = read_dir(d);
+    return d->listed;
+}
+
+static index_entry *find(index_dir *d, const char *name)
+{
+    index_entry key = { name, 0 };
+    return bsearch(&key, d->entries, d->count, sizeof(index_entry), compare_entries);
+}
+
+int path_index_lists(int dir, const char *name)
+{
+    index_dir *d = &idx.dirs[dir];
+    if (!ensure_listed(d))
+        return -1;
+    return find(d, name) != NULL;
+}
+
+static bool executable(const index_dir *d, index_entry *e)
+{
+    if (e->exec < 0) {
+        char full_path[PATH_MAX];
+        struct stat st;
+        snprintf(full_path, sizeof(full_path), "%s/%s", d->path, e->name);
+        e->exec = stat(full_path, &st) == 0 && S_ISREG(st.st_mode) &&
+                  access(full_path, X_OK) == 0;
+    }
+    return e->exec;
+}
+
+bool path_index_complete(int dir, const char *prefix,
+                         void (*fn)(const char *name, void *arg), void *arg)
+{
+    index_dir *d = &idx.dirs[dir];
+    bool kept = ensure_listed(d);
+    if (!kept && !read_dir(d))
+        return false;
+
+    // first name >= prefix; the matches follow it
+    size_t len = strlen(prefix);
+    size_t lo = 0, hi = d->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (strcmp(d->entries[mid].name, prefix) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    for (size_t i = lo; i < d->count && strncmp(d->entries[i].name, prefix, len) == 0; i++)
+        if (executable(d, &d->entries[i]))
+            fn(d->entries[i].name, arg);
+
+    if (!kept)
+        forget(d);
+    return true;
+}
+
+// Applies one event to the directory (or directories, through symlinks) it is about
+static void apply(const struct inotify_event *ev)
+{
+    for (size_t i = 0; i < idx.count; i++) {
+        index_dir *d = &idx.dirs[i];
+        if (!(ev->mask & IN_Q_OVERFLOW) && d->wd != ev->wd)
+            continue;
+        d->gen++;
+        if ((ev->mask & IN_ATTRIB) && ev->len > 0) {
+            // a chmod: the names stand, one entry needs checking again
+            index_entry *e = d->listed ? find(d, ev->name) : NULL;
+            if (e != NULL)
+                e->exec = -1;
+        } else {
+            d->listed = false;
+        }
+        if (ev->mask & IN_IGNORED)
+            d->wd = -1;     // the directory went away with its watch
+    }
+}
+
+bool path_index_poll(void)
+{
+    adopt();
+    if (idx.fd < 0)
+        return false;
+
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool changed = false;
+    while (1) {
+        ssize_t n = read(idx.fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        for (char *p = buf; p < buf + n; ) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            apply(ev);
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+        changed = true;
+    }
+    return changed;
+}
@@ -0,0 +1,204 @@
+#include "prompt.h"
+#include "vars.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+
+#define DEFAULT_PS1 "\\u@\\h:\\w> "
+
+typedef enum {
+    SEG_TEXT,
+    SEG_USER,
+    SEG_HOST,
+    SEG_CWD,
+    SEG_CWD_BASE,
+    SEG_DOLLAR
+} segment_kind;
+
+typedef struct {
+    segment_kind kind;
+    const char *text;           // SEG_TEXT: points into prompt.format
+    size_t len;
+} segment;
+
+static struct {
+    char *ps1;                  // $PS1 the segments were compiled from
+    char *format;               // ps1 with the escapes resolved
+    segment *segs;
+    size_t nsegs;
+
+    char *user;                 // $USER and $HOSTNAME at the last render
+    char *hostname;
+    char cwd[PATH_MAX];
+    bool cwd_valid;
+    char host[256];             // gethostname(), asked once
+
+    char *rendered;
+    size_t len;
+    size_t cap;
+    bool valid;
+    unsigned long vars_gen;     // vars_generation() at the last check
+} prompt;
+
+static void compile(const char *ps1)
+{
+    free(prompt.ps1);
+    free(prompt.format);
+    free(prompt.segs);
+    prompt.ps1 = strdup(ps1);
+
+    // Text segments never outgrow the format, and there is at most one
+    // segment per character
+    size_t n = strlen(ps1);
+    prompt.format = malloc(n + 1);
+    prompt.segs = malloc((n + 1) * sizeof(segment));
+    prompt.nsegs = 0;
+
+    char *out = prompt.format;
+    segment *text = NULL;
+    for (const char *p = ps1; *p; p++) {
+        char c = *p;
+        segment_kind kind = SEG_TEXT;
+        if (c == '\\' && p[1] != '\0') {
+            switch (*++p) {
+            case 'u': kind = SEG_USER; break;
+            case 'h': kind = SEG_HOST; break;
+            case 'w': kind = SEG_CWD; break;
+            case 'W': kind = SEG_CWD_BASE; break;
+            case '$': kind = SEG_DOLLAR; break;
+            case 'n': c = '\n'; break;
+            default: c = *p; break;
+            }
+        }
+
+        if (kind != SEG_TEXT) {
+            prompt.segs[prompt.nsegs++] = (segment){ kind, NULL, 0 };
+            text = NULL;
+            continue;
+        }
+        // Consecutive characters share one text segment
+        if (text == NULL) {
+            text = &prompt.segs[prompt.nsegs++];
+            *text = (segment){ SEG_TEXT, out, 0 };
+        }
+        *out++ = c;
+        text->len++;
+    }
+    *out = '\0';
+}
+
+// Replaces a cached copy if the value differs; returns true if it did
+static bool update(char **cached, const char *value)
+{
+    if (value == NULL ? *cached == NULL : (*cached != NULL && strcmp(*cached, value) == 0))
+        return false;
+    free(*cached);
+    *cached = value ? strdup(value) : NULL;
+    return true;
+}
+
+static void append(const char *s, size_t n)
+{
+    if (prompt.len + n > prompt.cap) {
+        prompt.cap = (prompt.len + n) * 2;
+        prompt.rendered = realloc(prompt.rendered, prompt.cap);
+    }
+    memcpy(prompt.rendered + prompt.len, s, n);
+    prompt.len += n;
+}
+
+static void append_str(const char *s)
+{
+    if (s != NULL)
+        append(s, strlen(s));
+}
+
+static void render(void)
+{
+    if (!prompt.cwd_valid) {
+        if (getcwd(prompt.cwd, sizeof(prompt.cwd)) == NULL)
+            prompt.cwd[0] = '\0';
+        prompt.cwd_valid = true;
+    }
+    const char *host = prompt.hostname;
+    if (host == NULL) {
+        if (prompt.host[0] == '\0')
+            gethostname(prompt.host, sizeof(prompt.host) - 1);
+        host = prompt.host;
+    }
+
+    prompt.len = 0;
+    for (size_t i = 0; i < prompt.nsegs; i++) {
+        const segment *seg = &prompt.segs[i];
+        switch (seg->kind) {
+        case SEG_TEXT:
+            append(seg->text, seg->len);
+            break;
+        case SEG_USER:
+            append_str(prompt.user ? prompt.user : "(null)");
+            break;
+        case SEG_HOST:
+            append_str(host);
+            break;
+        case SEG_CWD:
+            append_str(prompt.cwd);
+            break;
+        case SEG_CWD_BASE: {
+            const char *slash = strrchr(prompt.cwd, '/');
+            append_str(slash != NULL && slash[1] != '\0' ? slash + 1 : prompt.cwd);
+            break;
+        }
+        case SEG_DOLLAR:
+            append(geteuid() == 0 ? "#" : "$", 1);
+            break;
+        }
+    }
+    prompt.valid = true;
+}
+
+void print_prompt(void)
+{
+    // The inputs are only compared again after a variable changed
+    if (prompt.ps1 == NULL || prompt.vars_gen != vars_generation()) {
+        prompt.vars_gen = vars_generation();
+        const char *ps1 = vars_get("PS1");
+        if (ps1 == NULL)
+            ps1 = DEFAULT_PS1;
+        if (prompt.ps1 == NULL || strcmp(prompt.ps1, ps1) != 0) {
+            compile(ps1);
+            prompt.valid = false;
+        }
+        if (update(&prompt.user, vars_get("USER")))
+            prompt.valid = false;
+        if (update(&prompt.hostname, vars_get("HOSTNAME")))
+            prompt.valid = false;
+    }
+
+    if (!prompt.valid)
+        render();
+
+    // Output queued by builtins must come out first
+    fflush(stdout);
+    if (write(STDOUT_FILENO, prompt.rendered, prompt.len) < 0)
+        return;
+}
+
+void print_continuation_prompt(void)
+{
+    const char *ps2 = vars_get("PS2");
+    if (ps2 == NULL)
+        ps2 = "> ";
+    fflush(stdout);
+    if (write(STDOUT_FILENO, ps2, strlen(ps2)) < 0)
+        return;
+}
+
+void prompt_invalidate(void)
+{
+    prompt.cwd_valid = false;
+    prompt.valid = false;
+}
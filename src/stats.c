@@ -0,0 +1,156 @@
+#include "stats.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef SHELL_STATS
+
+static const char *phase_names[STAT_PHASES] = {
+    "input", "tokenize", "parse", "expand", "path", "spawn", "wait",
+};
+
+// 4 exact buckets below 4ns, then 4 per power of two up to 2^64
+#define STAT_BUCKETS 256
+
+typedef struct {
+    uint64_t count;
+    uint64_t total;
+    uint64_t max;
+    uint64_t buckets[STAT_BUCKETS];
+} stat_hist;
+
+static stat_hist hists[STAT_PHASES];
+
+static unsigned bucket_of(uint64_t ns)
+{
+    if (ns < 4)
+        return ns;
+    unsigned e = 63 - __builtin_clzll(ns);      // ns in [2^e, 2^(e+1))
+    return 4 * (e - 1) + ((ns >> (e - 2)) & 3);
+}
+
+// Largest value that falls in bucket b
+static uint64_t bucket_top(unsigned b)
+{
+    if (b < 4)
+        return b;
+    unsigned e = b / 4 + 1;
+    uint64_t width = 1ULL << (e - 2);
+    return (uint64_t)(4 + b % 4) * width + (width - 1);
+}
+
+void stats_record(stat_phase phase, uint64_t ns)
+{
+    stat_hist *h = &hists[phase];
+    h->count++;
+    h->total += ns;
+    if (ns > h->max)
+        h->max = ns;
+    h->buckets[bucket_of(ns)]++;
+}
+
+static uint64_t percentile(const stat_hist *h, double q)
+{
+    uint64_t rank = (uint64_t)(q * h->count + 0.5);
+    if (rank == 0)
+        rank = 1;
+    uint64_t seen = 0;
+    for (unsigned b = 0; b < STAT_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen >= rank)
+            return bucket_top(b) < h->max ? bucket_top(b) : h->max;
+    }
+    return h->max;
+}
+
+static const char *format_ns(char *buf, size_t size, uint64_t ns)
+{
+    if (ns < 1000)
+        snprintf(buf, size, "%lluns", (unsigned long long)ns);
+    else if (ns < 1000000)
+        snprintf(buf, size, "%.1fus", ns / 1e3);
+    else if (ns < 1000000000)
+        snprintf(buf, size, "%.1fms", ns / 1e6);
+    else
+        snprintf(buf, size, "%.2fs", ns / 1e9);
+    return buf;
+}
+
+static void print_histogram(const stat_hist *h)
+{
+    uint64_t peak = 0;
+    for (unsigned b = 0; b < STAT_BUCKETS; b++)
+        if (h->buckets[b] > peak)
+            peak = h->buckets[b];
+
+    for (unsigned b = 0; b < STAT_BUCKETS; b++) {
+        if (h->buckets[b] == 0)
+            continue;
+        char top[16];
+        char bar[41];
+        int width = (int)(h->buckets[b] * 40 / peak);
+        memset(bar, '#', width);
+        bar[width] = '\0';
+        printf("  <= %-9s %10llu  %s\n", format_ns(top, sizeof(top), bucket_top(b)),
+               (unsigned long long)h->buckets[b], bar);
+    }
+}
+
+bool stats_enabled(void)
+{
+    return true;
+}
+
+void stats_print(bool histograms)
+{
+    char total[16], mean[16], p50[16], p99[16], max[16];
+
+    printf("%-10s %8s %10s %10s %10s %10s %10s\n",
+           "phase", "count", "total", "mean", "p50", "p99", "max");
+    for (int i = 0; i < STAT_PHASES; i++) {
+        const stat_hist *h = &hists[i];
+        if (h->count == 0) {
+            printf("%-10s %8d\n", phase_names[i], 0);
+            continue;
+        }
+        printf("%-10s %8llu %10s %10s %10s %10s %10s\n", phase_names[i],
+               (unsigned long long)h->count,
+               format_ns(total, sizeof(total), h->total),
+               format_ns(mean, sizeof(mean), h->total / h->count),
+               format_ns(p50, sizeof(p50), percentile(h, 0.50)),
+               format_ns(p99, sizeof(p99), percentile(h, 0.99)),
+               format_ns(max, sizeof(max), h->max));
+    }
+
+    if (!histograms)
+        return;
+    for (int i = 0; i < STAT_PHASES; i++) {
+        if (hists[i].count == 0)
+            continue;
+        printf("\n%s:\n", phase_names[i]);
+        print_histogram(&hists[i]);
+    }
+}
+
+void stats_reset(void)
+{
+    memset(hists, 0, sizeof(hists));
+}
+
+#else
+
+bool stats_enabled(void)
+{
+    return false;
+}
+
+void stats_print(bool histograms)
+{
+    (void)histograms;
+}
+
+void stats_reset(void)
+{
+}
+
+#endif
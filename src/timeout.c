@@ -0,0 +1,265 @@
+#define _GNU_SOURCE
+
+#include "timeout.h"
+#include "job.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+
+typedef struct timed_proc {
+    pid_t pid;
+    int pidfd;                  // signals cannot hit a recycled pid
+    int timerfd;
+    int signal;
+    struct timespec kill_after;
+    int fired;                  // 0: armed, 1: signal sent, 2: SIGKILL sent
+    struct timed_proc *next;
+} timed_proc;
+
+static timed_proc *armed;       // few at a time, so a plain list
+static int epoll_fd = -1;       // every armed timerfd
+
+static const struct { const char *name; int sig; } signals[] = {
+    { "HUP", SIGHUP }, { "INT", SIGINT }, { "QUIT", SIGQUIT },
+    { "KILL", SIGKILL }, { "USR1", SIGUSR1 }, { "USR2", SIGUSR2 },
+    { "PIPE", SIGPIPE }, { "ALRM", SIGALRM }, { "TERM", SIGTERM },
+    { "CONT", SIGCONT }, { "STOP", SIGSTOP },
+};
+
+static int parse_signal(const char *s)
+{
+    char *end;
+    long n = strtol(s, &end, 10);
+    if (*s != '\0' && *end == '\0')
+        return n > 0 && n < NSIG ? (int)n : -1;
+
+    if (strncasecmp(s, "SIG", 3) == 0)
+        s += 3;
+    for (size_t i = 0; i < sizeof(signals) / sizeof(signals[0]); i++)
+        if (strcasecmp(s, signals[i].name) == 0)
+            return signals[i].sig;
+    return -1;
+}
+
+// "1.5", "30s", "2m", "1h", "1d", as timeout(1)
+static bool parse_duration(const char *s, struct timespec *ts)
+{
+    char *end;
+    double secs = strtod(s, &end);
+    if (end == s || secs < 0 || !isfinite(secs))
+        return false;
+
+    switch (*end) {
+    case '\0':
+    case 's': break;
+    case 'm': secs *= 60; break;
+    case 'h': secs *= 60 * 60; break;
+    case 'd': secs *= 60 * 60 * 24; break;
+    default: return false;
+    }
+    if (*end != '\0' && end[1] != '\0')
+        return false;
+    // the whole seconds must fit a (signed) time_t
+    if (secs >= ldexp(1, sizeof(time_t) * CHAR_BIT - 1))
+        return false;
+
+    ts->tv_sec = (time_t)secs;
+    ts->tv_nsec = (long)((secs - (double)ts->tv_sec) * 1e9);
+    return true;
+}
+
+int timeout_parse(char **argv, timeout_spec *spec)
+{
+    if (argv[0] == NULL || strcmp(argv[0], "timeout") != 0)
+        return 0;
+
+    spec->signal = SIGTERM;
+    spec->kill_after = (struct timespec){ 0, 0 };
+
+    int i = 1;
+    while (argv[i] != NULL && (strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "-k") == 0)) {
+        if (argv[i + 1] == NULL)
+            break;
+        if (argv[i][1] == 's') {
+            spec->signal = parse_signal(argv[i + 1]);
+            if (spec->signal < 0) {
+                fprintf(stderr, "timeout: %s: invalid signal\n", argv[i + 1]);
+                return -1;
+            }
+        } else if (!parse_duration(argv[i + 1], &spec->kill_after)) {
+            fprintf(stderr, "timeout: invalid time interval '%s'\n", argv[i + 1]);
+            return -1;
+        }
+        i += 2;
+    }
+
+    if (argv[i] == NULL || argv[i + 1] == NULL) {
+        fprintf(stderr, "usage: timeout [-s SIG] [-k KILL_AFTER] DURATION cmd [arg...]\n");
+        return -1;
+    }
+    if (!parse_duration(argv[i], &spec->duration)) {
+        fprintf(stderr, "timeout: invalid time interval '%s'\n", argv[i]);
+        return -1;
+    }
+    spec->words = i + 1;
+    return 1;
+}
+
+int timeout_fd(void)
+{
+    if (epoll_fd < 0)
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    return epoll_fd;
+}
+
+static void set_timer(int fd, struct timespec after)
+{
+    struct itimerspec its = { .it_value = after };
+    timerfd_settime(fd, 0, &its, NULL);
+}
+
+void timeout_arm(pid_t pid, const timeout_spec *spec)
+{
+    // A zero duration disables the timeout, as in timeout(1)
+    if (spec->duration.tv_sec == 0 && spec->duration.tv_nsec == 0)
+        return;
+
+    // The child is not reaped before its parent asks, so this cannot race
+    int pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+    if (pidfd < 0) {
+        perror("timeout: pidfd_open");
+        return;
+    }
+    int timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerfd < 0) {
+        perror("timeout: timerfd_create");
+        close(pidfd);
+        return;
+    }
+
+    timed_proc *t = malloc(sizeof(timed_proc));
+    t->pid = pid;
+    t->pidfd = pidfd;
+    t->timerfd = timerfd;
+    t->signal = spec->signal;
+    t->kill_after = spec->kill_after;
+    t->fired = 0;
+    t->next = armed;
+    armed = t;
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = t };
+    epoll_ctl(timeout_fd(), EPOLL_CTL_ADD, timerfd, &ev);
+    set_timer(timerfd, spec->duration);
+}
+
+static void fire(timed_proc *t)
+{
+    uint64_t expirations;
+    if (read(t->timerfd, &expirations, sizeof(expirations)) < 0)
+        return;     // already handled
+
+    if (t->fired == 0) {
+        syscall(SYS_pidfd_send_signal, t->pidfd, t->signal, NULL, 0);
+        // a stopped child would never act on the signal
+        if (t->signal != SIGKILL && t->signal != SIGCONT)
+            syscall(SYS_pidfd_send_signal, t->pidfd, SIGCONT, NULL, 0);
+        t->fired = 1;
+        if (t->kill_after.tv_sec != 0 || t->kill_after.tv_nsec != 0)
+            set_timer(t->timerfd, t->kill_after);
+    } else if (t->fired == 1) {
+        syscall(SYS_pidfd_send_signal, t->pidfd, SIGKILL, NULL, 0);
+        t->fired = 2;
+    }
+}
+
+void timeout_dispatch(void)
+{
+    struct epoll_event events[16];
+    int n;
+    if (epoll_fd < 0)
+        return;
+    do {
+        n = epoll_wait(epoll_fd, events, 16, 0);
+        for (int i = 0; i < n; i++)
+            fire(events[i].data.ptr);
+    } while (n == 16);
+}
+
+int timeout_reaped(pid_t pid, int status)
+{
+    timed_proc **link = &armed;
+    while (*link != NULL && (*link)->pid != pid)
+        link = &(*link)->next;
+
+    timed_proc *t = *link;
+    if (t == NULL)
+        return exit_status(status);
+
+    *link = t->next;
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, t->timerfd, NULL);
+    close(t->timerfd);
+    close(t->pidfd);
+    bool timed_out = t->fired > 0;
+    free(t);
+
+    if (!timed_out)
+        return exit_status(status);
+    if (WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL)
+        return 128 + SIGKILL;
+    return 124;
+}
+
+int timeout_wait(pid_t pid, struct rusage *usage)
+{
+    int status = 0;
+    if (armed == NULL) {
+        while (wait4(pid, &status, 0, usage) < 0 && errno == EINTR)
+            ;
+        return exit_status(status);
+    }
+
+    // Sleep on the child's pidfd and the timers at once
+    int pidfd = -1;
+    for (timed_proc *t = armed; t != NULL && pidfd < 0; t = t->next)
+        if (t->pid == pid)
+            pidfd = t->pidfd;
+    bool own_pidfd = pidfd < 0;
+    if (own_pidfd)
+        pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+
+    while (pidfd >= 0) {
+        struct pollfd fds[2] = {
+            { .fd = pidfd, .events = POLLIN },
+            { .fd = epoll_fd, .events = POLLIN },
+        };
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (fds[1].revents & POLLIN)
+            timeout_dispatch();
+        if (fds[0].revents)
+            break;
+    }
+    if (own_pidfd && pidfd >= 0)
+        close(pidfd);
+
+    while (wait4(pid, &status, 0, usage) < 0 && errno == EINTR)
+        ;
+    return timeout_reaped(pid, status);
+}
@@ -0,0 +1,910 @@
+#include "utilities.h"
+#include "copy.h"
+#include "launch.h"
+#include "path.h"
+#include "timeout.h"
+#include "vars.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Output is flushed before returning so a failed write shows in the status
+static int finish_output(const char *name)
+{
+    if (fflush(stdout) == 0 && !ferror(stdout))
+        return 0;
+    fprintf(stderr, "%s: write error: %s\n", name, strerror(errno));
+    clearerr(stdout);
+    return 1;
+}
+
+// Backslash escapes: \NNN in printf formats, \0NNN in echo -e, both in %b
+typedef enum { OCT_FORMAT, OCT_ECHO, OCT_B } octal_style;
+
+#define ESC_STOP -1     // \c: no further output
+#define ESC_NONE -2     // not an escape: the backslash is literal
+
+/**
+ * Decodes the escape following a backslash into *c.
+ * Returns the rest of the string.
+ */
+static const char *unescape(const char *s, int *c, octal_style style)
+{
+    switch (*s) {
+    case 'a':  *c = '\a'; return s + 1;
+    case 'b':  *c = '\b'; return s + 1;
+    case 'e':  *c = 033;  return s + 1;
+    case 'f':  *c = '\f'; return s + 1;
+    case 'n':  *c = '\n'; return s + 1;
+    case 'r':  *c = '\r'; return s + 1;
+    case 't':  *c = '\t'; return s + 1;
+    case 'v':  *c = '\v'; return s + 1;
+    case '\\': *c = '\\'; return s + 1;
+    case 'c':  *c = ESC_STOP; return s + 1;
+    case 'x':
+        if (!isxdigit((unsigned char)s[1]))
+            break;
+        *c = 0;
+        s++;
+        for (int n = 0; n < 2 && isxdigit((unsigned char)*s); n++, s++)
+            *c = *c * 16 + (isdigit((unsigned char)*s) ? *s - '0' : tolower((unsigned char)*s) - 'a' + 10);
+        return s;
+    default:
+        if (*s < '0' || *s > '7' || (style == OCT_ECHO && *s != '0'))
+            break;
+        if (style != OCT_FORMAT && *s == '0')
+            s++;
+        *c = 0;
+        for (int n = 0; n < 3 && *s >= '0' && *s <= '7'; n++)
+            *c = *c * 8 + (*s++ - '0');
+        *c &= 0xff;
+        return s;
+    }
+    *c = ESC_NONE;
+    return s;
+}
+
+// Writes s with its escapes decoded; returns false at \c
+static bool put_escaped(const char *s, octal_style style, FILE *out)
+{
+    while (*s) {
+        if (*s != '\\') {
+            putc(*s++, out);
+            continue;
+        }
+        int c;
+        s = unescape(s + 1, &c, style);
+        if (c == ESC_STOP)
+            return false;
+        putc(c == ESC_NONE ? '\\' : c, out);
+    }
+    return true;
+}
+
+/**
+ * echo [-neE] [string...]
+ * Options are only recognised before the first operand, and only when
+ * made up entirely of n, e and E.
+ */
+int echo_builtin(int argc, char **argv)
+{
+    bool newline = true;
+    bool escapes = false;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        const char *opt = argv[i] + 1;
+        if (opt[strspn(opt, "neE")] != '\0')
+            break;
+        for (; *opt; opt++) {
+            if (*opt == 'n')
+                newline = false;
+            else
+                escapes = (*opt == 'e');
+        }
+    }
+
+    for (; i < argc; i++) {
+        if (!escapes)
+            fputs(argv[i], stdout);
+        else if (!put_escaped(argv[i], OCT_ECHO, stdout))
+            return finish_output("echo");   // \c drops the newline too
+        if (i + 1 < argc)
+            putchar(' ');
+    }
+    if (newline)
+        putchar('\n');
+    return finish_output("echo");
+}
+
+// The operands left for printf's conversions
+typedef struct {
+    char **argv;
+    int argc;
+    int next;
+    int status;
+} printf_args;
+
+static const char *next_arg(printf_args *args)
+{
+    return args->next < args->argc ? args->argv[args->next++] : NULL;
+}
+
+static void check_numeric(printf_args *args, const char *s, const char *end)
+{
+    if (end == s || *end != '\0') {
+        fprintf(stderr, "printf: '%s': expected a numeric value\n", s);
+        args->status = 1;
+    } else if (errno == ERANGE) {
+        fprintf(stderr, "printf: '%s': %s\n", s, strerror(ERANGE));
+        args->status = 1;
+    }
+}
+
+// Numeric operands may also be 'c (or "c): the character's value
+static intmax_t int_arg(printf_args *args)
+{
+    const char *s = next_arg(args);
+    if (s == NULL)
+        return 0;
+    if (s[0] == '\'' || s[0] == '"')
+        return (unsigned char)s[1];
+    char *end;
+    errno = 0;
+    intmax_t v = strtoimax(s, &end, 0);
+    check_numeric(args, s, end);
+    return v;
+}
+
+static uintmax_t uint_arg(printf_args *args)
+{
+    const char *s = next_arg(args);
+    if (s == NULL)
+        return 0;
+    if (s[0] == '\'' || s[0] == '"')
+        return (unsigned char)s[1];
+    char *end;
+    errno = 0;
+    uintmax_t v = strtoumax(s, &end, 0);
+    check_numeric(args, s, end);
+    return v;
+}
+
+static long double float_arg(printf_args *args)
+{
+    const char *s = next_arg(args);
+    if (s == NULL)
+        return 0;
+    if (s[0] == '\'' || s[0] == '"')
+        return (unsigned char)s[1];
+    char *end;
+    errno = 0;
+    long double v = strtold(s, &end);
+    check_numeric(args, s, end);
+    return v;
+}
+
+/**
+ * Prints one pass over the format. Each conversion is rebuilt as a
+ * host printf() spec with the widest length modifier for its type.
+ * Returns false when output must stop (\c or a bad conversion).
+ */
+static bool print_format(const char *f, printf_args *args)
+{
+    while (*f) {
+        if (*f == '\\') {
+            int c;
+            f = unescape(f + 1, &c, OCT_FORMAT);
+            if (c == ESC_STOP)
+                return false;
+            putchar(c == ESC_NONE ? '\\' : c);
+            continue;
+        }
+        if (*f != '%') {
+            putchar(*f++);
+            continue;
+        }
+        if (f[1] == '%') {
+            putchar('%');
+            f += 2;
+            continue;
+        }
+
+        const char *start = f++;
+        char spec[64] = "%";
+        size_t n = 1;
+        while (*f && strchr("-+ #0", *f)) {
+            if (n < 8)
+                spec[n++] = *f;
+            f++;
+        }
+        for (int part = 0; part < 2; part++) {
+            // width, then precision
+            if (part == 1) {
+                if (*f != '.')
+                    break;
+                spec[n++] = *f++;
+            }
+            if (*f == '*') {
+                n += snprintf(spec + n, 24, "%d", (int)int_arg(args));
+                f++;
+            } else {
+                while (isdigit((unsigned char)*f)) {
+                    if (n < 40)
+                        spec[n++] = *f;
+                    f++;
+                }
+            }
+        }
+
+        char conv = *f;
+        if (conv == '\0' || strchr("diouxXfFeEgGaAcsb", conv) == NULL) {
+            fprintf(stderr, "printf: %.*s: invalid conversion specification\n",
+                    (int)(f - start + (conv != '\0')), start);
+            args->status = 1;
+            return false;
+        }
+        f++;
+
+        if (strchr("di", conv)) {
+            memcpy(spec + n, (char[]){ 'j', conv, '\0' }, 3);
+            intmax_t v = int_arg(args);
+            printf(spec, v);
+        } else if (strchr("ouxX", conv)) {
+            memcpy(spec + n, (char[]){ 'j', conv, '\0' }, 3);
+            uintmax_t v = uint_arg(args);
+            printf(spec, v);
+        } else if (strchr("fFeEgGaA", conv)) {
+            memcpy(spec + n, (char[]){ 'L', conv, '\0' }, 3);
+            long double v = float_arg(args);
+            printf(spec, v);
+        } else if (conv == 'c') {
+            memcpy(spec + n, "c", 2);
+            const char *s = next_arg(args);
+            printf(spec, s ? s[0] : '\0');
+        } else if (conv == 's') {
+            memcpy(spec + n, "s", 2);
+            const char *s = next_arg(args);
+            printf(spec, s ? s : "");
+        } else {
+            // %b: the operand's escapes are decoded, then padded as %s
+            const char *s = next_arg(args);
+            char *decoded = NULL;
+            size_t len = 0;
+            FILE *mem = open_memstream(&decoded, &len);
+            bool more = put_escaped(s ? s : "", OCT_B, mem);
+            fclose(mem);
+            memcpy(spec + n, "s", 2);
+            printf(spec, decoded);
+            free(decoded);
+            if (!more)
+                return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * printf FORMAT [argument...]
+ * The format is reused while operands remain, and missing operands read
+ * as 0 or the empty string.
+ */
+int printf_builtin(int argc, char **argv)
+{
+    int first = (argc > 1 && strcmp(argv[1], "--") == 0) ? 2 : 1;
+    if (argc <= first) {
+        fprintf(stderr, "printf: missing operand\n");
+        return 1;
+    }
+
+    printf_args args = { argv + first + 1, argc - first - 1, 0, 0 };
+    int consumed;
+    bool more;
+    do {
+        consumed = args.next;
+        more = print_format(argv[first], &args);
+    } while (more && args.next < args.argc && args.next > consumed);
+    if (more && args.next == 0 && args.argc > 0)
+        fprintf(stderr, "printf: warning: ignoring excess arguments, starting with '%s'\n", args.argv[0]);
+
+    int status = finish_output("printf");
+    return status ? status : args.status;
+}
+
+// test's operands and the parser's position in them
+static struct {
+    const char *name;
+    char **argv;
+    int argc;
+    int pos;
+    bool failed;
+} t;
+
+static bool test_fail(const char *fmt, const char *arg)
+{
+    if (!t.failed) {
+        fprintf(stderr, "%s: ", t.name);
+        fprintf(stderr, fmt, arg);
+        fputc('\n', stderr);
+    }
+    t.failed = true;
+    return false;
+}
+
+static bool is_unary_op(const char *op)
+{
+    return op[0] == '-' && op[1] != '\0' && op[2] == '\0'
+        && strchr("bcdefghknprstuwxzGLOS", op[1]) != NULL;
+}
+
+static bool is_binary_op(const char *op)
+{
+    static const char *const ops[] = {
+        "=", "==", "!=", "-eq", "-ne", "-lt", "-le", "-gt", "-ge",
+        "-nt", "-ot", "-ef", NULL
+    };
+    for (const char *const *o = ops; *o != NULL; o++)
+        if (strcmp(op, *o) == 0)
+            return true;
+    return false;
+}
+
+static bool unary(const char *op, const char *arg)
+{
+    struct stat st;
+    switch (op[1]) {
+    case 'n': return arg[0] != '\0';
+    case 'z': return arg[0] == '\0';
+    case 't': return isatty(atoi(arg));
+    case 'r': return faccessat(AT_FDCWD, arg, R_OK, AT_EACCESS) == 0;
+    case 'w': return faccessat(AT_FDCWD, arg, W_OK, AT_EACCESS) == 0;
+    case 'x': return faccessat(AT_FDCWD, arg, X_OK, AT_EACCESS) == 0;
+    case 'h':
+    case 'L': return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+    }
+
+    if (stat(arg, &st) != 0)
+        return false;
+    switch (op[1]) {
+    case 'b': return S_ISBLK(st.st_mode);
+    case 'c': return S_ISCHR(st.st_mode);
+    case 'd': return S_ISDIR(st.st_mode);
+    case 'e': return true;
+    case 'f': return S_ISREG(st.st_mode);
+    case 'g': return (st.st_mode & S_ISGID) != 0;
+    case 'k': return (st.st_mode & S_ISVTX) != 0;
+    case 'p': return S_ISFIFO(st.st_mode);
+    case 's': return st.st_size > 0;
+    case 'u': return (st.st_mode & S_ISUID) != 0;
+    case 'G': return st.st_gid == getegid();
+    case 'O': return st.st_uid == geteuid();
+    case 'S': return S_ISSOCK(st.st_mode);
+    }
+    return false;
+}
+
+// Integers may have surrounding blanks, as in coreutils
+static intmax_t test_int(const char *s)
+{
+    char *end;
+    errno = 0;
+    intmax_t v = strtoimax(s, &end, 10);
+    while (isspace((unsigned char)*end))
+        end++;
+    if (end == s || *end != '\0' || errno == ERANGE)
+        test_fail("invalid integer '%s'", s);
+    return v;
+}
+
+static bool binary(const char *a, const char *op, const char *b)
+{
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0)
+        return strcmp(a, b) == 0;
+    if (strcmp(op, "!=") == 0)
+        return strcmp(a, b) != 0;
+
+    if (op[1] == 'n' || op[1] == 'o' || (op[1] == 'e' && op[2] == 'f')) {
+        struct stat sa, sb;
+        bool ha = stat(a, &sa) == 0;
+        bool hb = stat(b, &sb) == 0;
+        if (op[1] == 'e')
+            return ha && hb && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+        if (op[1] == 'o') {
+            struct stat tmp = sa;
+            bool htmp = ha;
+            sa = sb, ha = hb;
+            sb = tmp, hb = htmp;
+        }
+        // -nt: a exists and b does not, or a was modified later
+        if (!ha)
+            return false;
+        if (!hb)
+            return true;
+        return sa.st_mtim.tv_sec != sb.st_mtim.tv_sec
+             ? sa.st_mtim.tv_sec > sb.st_mtim.tv_sec
+             : sa.st_mtim.tv_nsec > sb.st_mtim.tv_nsec;
+    }
+
+    intmax_t x = test_int(a);
+    intmax_t y = test_int(b);
+    if (strcmp(op, "-eq") == 0) return x == y;
+    if (strcmp(op, "-ne") == 0) return x != y;
+    if (strcmp(op, "-lt") == 0) return x < y;
+    if (strcmp(op, "-le") == 0) return x <= y;
+    if (strcmp(op, "-gt") == 0) return x > y;
+    return x >= y;
+}
+
+// More than four operands: -o binds loosest, then -a, then !
+static bool parse_or(void);
+
+static bool parse_primary(void)
+{
+    if (t.pos >= t.argc)
+        return test_fail("%s", "argument expected");
+    const char *a = t.argv[t.pos];
+
+    if (strcmp(a, "(") == 0) {
+        t.pos++;
+        bool r = parse_or();
+        if (t.pos >= t.argc || strcmp(t.argv[t.pos], ")") != 0)
+            return test_fail("%s", "')' expected");
+        t.pos++;
+        return r;
+    }
+    if (t.pos + 2 < t.argc && is_binary_op(t.argv[t.pos + 1])) {
+        t.pos += 3;
+        return binary(a, t.argv[t.pos - 2], t.argv[t.pos - 1]);
+    }
+    if (is_unary_op(a) && t.pos + 1 < t.argc) {
+        t.pos += 2;
+        return unary(a, t.argv[t.pos - 1]);
+    }
+    t.pos++;
+    return a[0] != '\0';
+}
+
+static bool parse_not(void)
+{
+    if (t.pos < t.argc && strcmp(t.argv[t.pos], "!") == 0) {
+        t.pos++;
+        return !parse_not();
+    }
+    return parse_primary();
+}
+
+static bool parse_and(void)
+{
+    bool r = parse_not();
+    while (t.pos < t.argc && strcmp(t.argv[t.pos], "-a") == 0) {
+        t.pos++;
+        r = parse_not() && r;
+    }
+    return r;
+}
+
+static bool parse_or(void)
+{
+    bool r = parse_and();
+    while (t.pos < t.argc && strcmp(t.argv[t.pos], "-o") == 0) {
+        t.pos++;
+        r = parse_and() || r;
+    }
+    return r;
+}
+
+/**
+ * Up to four operands are decided by their count, as POSIX specifies, so
+ * e.g. `test -n` and `test ! = x` mean what they say; longer expressions
+ * go through the parser.
+ */
+static bool eval_test(char **a, int n)
+{
+    switch (n) {
+    case 0:
+        return false;
+    case 1:
+        return a[0][0] != '\0';
+    case 2:
+        if (strcmp(a[0], "!") == 0)
+            return !eval_test(a + 1, 1);
+        if (is_unary_op(a[0]))
+            return unary(a[0], a[1]);
+        return test_fail("'%s': unary operator expected", a[0]);
+    case 3:
+        if (is_binary_op(a[1]))
+            return binary(a[0], a[1], a[2]);
+        if (strcmp(a[1], "-a") == 0)
+            return a[0][0] != '\0' && a[2][0] != '\0';
+        if (strcmp(a[1], "-o") == 0)
+            return a[0][0] != '\0' || a[2][0] != '\0';
+        if (strcmp(a[0], "!") == 0)
+            return !eval_test(a + 1, 2);
+        if (strcmp(a[0], "(") == 0 && strcmp(a[2], ")") == 0)
+            return eval_test(a + 1, 1);
+        return test_fail("'%s': binary operator expected", a[1]);
+    case 4:
+        if (strcmp(a[0], "!") == 0)
+            return !eval_test(a + 1, 3);
+        if (strcmp(a[0], "(") == 0 && strcmp(a[3], ")") == 0)
+            return eval_test(a + 1, 2);
+        break;
+    }
+
+    t.argv = a;
+    t.argc = n;
+    t.pos = 0;
+    bool r = parse_or();
+    if (t.pos < t.argc)
+        test_fail("extra argument '%s'", t.argv[t.pos]);
+    return r;
+}
+
+/**
+ * test expression / [ expression ]
+ * Status 0 if the expression is true, 1 if false, 2 on a usage error.
+ */
+int test_builtin(int argc, char **argv)
+{
+    t.name = argv[0];
+    t.failed = false;
+    if (strcmp(argv[0], "[") == 0) {
+        if (strcmp(argv[argc - 1], "]") != 0) {
+            fprintf(stderr, "[: missing ']'\n");
+            return 2;
+        }
+        argc--;
+    }
+
+    bool r = eval_test(argv + 1, argc - 1);
+    return t.failed ? 2 : !r;
+}
+
+// $PWD names the working directory without . or .. components
+static bool valid_pwd(const char *pwd)
+{
+    if (pwd == NULL || pwd[0] != '/')
+        return false;
+    for (const char *p = pwd; (p = strchr(p, '/')) != NULL; ) {
+        p++;
+        size_t len = strcspn(p, "/");
+        if ((len == 1 && p[0] == '.') || (len == 2 && p[0] == '.' && p[1] == '.'))
+            return false;
+    }
+    struct stat a, b;
+    return stat(pwd, &a) == 0 && stat(".", &b) == 0
+        && a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+}
+
+/**
+ * pwd [-L | -P]
+ * -L (the default, as POSIX specifies) prints $PWD when it still names
+ * the working directory; -P always prints the physical path.
+ */
+int pwd_builtin(int argc, char **argv)
+{
+    bool logical = true;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        }
+        for (const char *opt = argv[i] + 1; *opt; opt++) {
+            if (*opt != 'L' && *opt != 'P') {
+                fprintf(stderr, "pwd: invalid option -- '%c'\n", *opt);
+                return 1;
+            }
+            logical = (*opt == 'L');
+        }
+    }
+    if (i < argc)
+        fprintf(stderr, "pwd: ignoring non-option arguments\n");
+
+    const char *pwd = vars_get("PWD");
+    if (logical && valid_pwd(pwd)) {
+        puts(pwd);
+    } else {
+        char cwd[PATH_MAX];
+        if (getcwd(cwd, sizeof(cwd)) == NULL) {
+            fprintf(stderr, "pwd: %s\n", strerror(errno));
+            return 1;
+        }
+        puts(cwd);
+    }
+    return finish_output("pwd");
+}
+
+/**
+ * Options a builtin does not implement (cat -n, tee --help, ...) are left
+ * to the utility of the same name in PATH, run with the same stdin/stdout.
+ */
+static int run_external(char **argv)
+{
+    char *path = search_path(argv[0]);
+    if (path == NULL) {
+        fprintf(stderr, "%s: unsupported option\n", argv[0]);
+        return 1;
+    }
+    fflush(stdout);
+    launch_t l = { path, argv, -1, -1, -1, NULL };
+    pid_t pid = launch(&l);
+    free(path);
+    if (pid < 0)
+        return 127;
+    struct rusage usage;
+    return timeout_wait(pid, &usage);
+}
+
+/**
+ * cat f >> f would never reach the end of f. As coreutils, refuses a
+ * regular file that is also the output unless the output position is
+ * already past its end.
+ */
+static bool is_output_file(int fd)
+{
+    struct stat in, out;
+    if (fstat(fd, &in) < 0 || fstat(STDOUT_FILENO, &out) < 0 ||
+        !S_ISREG(in.st_mode) || in.st_dev != out.st_dev || in.st_ino != out.st_ino)
+        return false;
+    int flags = fcntl(STDOUT_FILENO, F_GETFL);
+    return (flags >= 0 && (flags & O_APPEND)) ||
+           lseek(STDOUT_FILENO, 0, SEEK_CUR) < in.st_size;
+}
+
+int cat_builtin(int argc, char **argv)
+{
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        }
+        // -u (unbuffered) is how this cat always works
+        if (argv[i][strspn(argv[i] + 1, "u") + 1] != '\0')
+            return run_external(argv);
+    }
+
+    static char *stdin_only[] = { "-", NULL };
+    char **files = i < argc ? argv + i : stdin_only;
+    int nfiles = i < argc ? argc - i : 1;
+    int status = 0;
+
+    fflush(stdout);
+    for (int f = 0; f < nfiles; f++) {
+        bool from_stdin = strcmp(files[f], "-") == 0;
+        int fd = from_stdin ? STDIN_FILENO : open(files[f], O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            fprintf(stderr, "cat: %s: %s\n", files[f], strerror(errno));
+            status = 1;
+            continue;
+        }
+        if (is_output_file(fd)) {
+            fprintf(stderr, "cat: %s: input file is output file\n", files[f]);
+            if (!from_stdin)
+                close(fd);
+            status = 1;
+            continue;
+        }
+        copy_result r = copy_fd(fd, STDOUT_FILENO);
+        int err = errno;
+        if (!from_stdin)
+            close(fd);
+        if (r == COPY_WRITE_ERROR) {
+            fprintf(stderr, "cat: write error: %s\n", strerror(err));
+            return 1;
+        }
+        if (r == COPY_READ_ERROR) {
+            fprintf(stderr, "cat: %s: %s\n", files[f], strerror(err));
+            status = 1;
+        }
+    }
+    return status;
+}
+
+int tee_builtin(int argc, char **argv)
+{
+    bool append = false;
+    bool ignore_int = false;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        }
+        if (argv[i][strspn(argv[i] + 1, "ai") + 1] != '\0')
+            return run_external(argv);
+        append |= strchr(argv[i], 'a') != NULL;
+        ignore_int |= strchr(argv[i], 'i') != NULL;
+    }
+
+    // outs[0] is stdout; names[k] is the file behind outs[k]
+    tee_out outs[argc - i + 1];
+    const char *names[argc - i + 1];
+    int nouts = 1;
+    int status = 0;
+    outs[0] = (tee_out){ STDOUT_FILENO, 0 };
+    names[0] = "standard output";
+    for (; i < argc; i++) {
+        int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC);
+        int fd = open(argv[i], flags, 0666);
+        if (fd < 0) {
+            fprintf(stderr, "tee: %s: %s\n", argv[i], strerror(errno));
+            status = 1;
+            continue;
+        }
+        outs[nouts] = (tee_out){ fd, 0 };
+        names[nouts++] = argv[i];
+    }
+
+    // -i: the shell's own SIGINT disposition comes back afterwards
+    struct sigaction ignore = { .sa_handler = SIG_IGN };
+    struct sigaction saved;
+    if (ignore_int)
+        sigaction(SIGINT, &ignore, &saved);
+
+    fflush(stdout);
+    if (tee_fds(STDIN_FILENO, outs, nouts) == COPY_READ_ERROR) {
+        fprintf(stderr, "tee: read error: %s\n", strerror(errno));
+        status = 1;
+    }
+    if (ignore_int)
+        sigaction(SIGINT, &saved, NULL);
+
+    for (int k = 0; k < nouts; k++) {
+        if (outs[k].error != 0) {
+            fprintf(stderr, "tee: %s: %s\n", names[k], strerror(outs[k].error));
+            status = 1;
+        }
+        if (k > 0)
+            close(outs[k].fd);
+    }
+    return status;
+}
+
+// Copies one file to dest; the new file gets src's permission bits
+static int copy_file(const char *src, const char *dest)
+{
+    int in = open(src, O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        fprintf(stderr, errno == ENOENT ? "cp: cannot stat '%s': %s\n"
+                                        : "cp: cannot open '%s' for reading: %s\n",
+                src, strerror(errno));
+        return 1;
+    }
+    struct stat in_st, out_st;
+    fstat(in, &in_st);
+    if (S_ISDIR(in_st.st_mode)) {
+        fprintf(stderr, "cp: -r not specified; omitting directory '%s'\n", src);
+        close(in);
+        return 1;
+    }
+    if (stat(dest, &out_st) == 0 && out_st.st_dev == in_st.st_dev && out_st.st_ino == in_st.st_ino) {
+        fprintf(stderr, "cp: '%s' and '%s' are the same file\n", src, dest);
+        close(in);
+        return 1;
+    }
+
+    int out = open(dest, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, in_st.st_mode & 07777);
+    if (out < 0) {
+        fprintf(stderr, "cp: cannot create regular file '%s': %s\n", dest, strerror(errno));
+        close(in);
+        return 1;
+    }
+
+    int status = 0;
+    copy_result r = copy_fd(in, out);
+    if (r != COPY_OK) {
+        fprintf(stderr, "cp: error %s '%s': %s\n", r == COPY_READ_ERROR ? "reading" : "writing",
+                r == COPY_READ_ERROR ? src : dest, strerror(errno));
+        status = 1;
+    }
+    close(in);
+    if (close(out) < 0 && status == 0) {
+        fprintf(stderr, "cp: failed to close '%s': %s\n", dest, strerror(errno));
+        status = 1;
+    }
+    return status;
+}
+
+int cp_builtin(int argc, char **argv)
+{
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        }
+        return run_external(argv);
+    }
+
+    int nsrc = argc - i - 1;
+    if (nsrc < 1) {
+        if (nsrc < 0)
+            fprintf(stderr, "cp: missing file operand\n");
+        else
+            fprintf(stderr, "cp: missing destination file operand after '%s'\n", argv[i]);
+        return 1;
+    }
+
+    const char *target = argv[argc - 1];
+    struct stat st;
+    bool into_dir = stat(target, &st) == 0 && S_ISDIR(st.st_mode);
+    if (!into_dir) {
+        if (nsrc > 1) {
+            fprintf(stderr, "cp: target '%s' is not a directory\n", target);
+            return 1;
+        }
+        return copy_file(argv[i], target);
+    }
+
+    int status = 0;
+    for (; i < argc - 1; i++) {
+        const char *base = strrchr(argv[i], '/');
+        base = base ? base + 1 : argv[i];
+        char dest[PATH_MAX];
+        if (snprintf(dest, sizeof(dest), "%s/%s", target, base) >= (int)sizeof(dest)) {
+            fprintf(stderr, "cp: %s/%s: %s\n", target, base, strerror(ENAMETOOLONG));
+            status = 1;
+            continue;
+        }
+        status |= copy_file(argv[i], dest);
+    }
+    return status;
+}
+
+/**
+ * env [-i] [NAME=value]... [COMMAND [ARG...]]: the exported variables
+ * (none with -i) plus the assignments, printed or given to COMMAND. Only
+ * pointers to the shell's environment snapshot are copied.
+ */
+int env_builtin(int argc, char **argv)
+{
+    bool empty = false;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        }
+        if (strcmp(argv[i], "-i") != 0 && strcmp(argv[i], "-") != 0)
+            return run_external(argv);
+        empty = true;
+    }
+    int first = i;
+    while (i < argc && strchr(argv[i], '=') != NULL)
+        i++;
+
+    char **envp = vars_environ_with(argv + first, i - first, empty);
+    int status;
+    if (i == argc) {
+        for (char **e = envp; *e != NULL; e++)
+            puts(*e);
+        status = finish_output("env");
+    } else {
+        // COMMAND is found in the shell's PATH, not an assigned one
+        char *path = search_path(argv[i]);
+        if (path == NULL) {
+            fprintf(stderr, "env: '%s': No such file or directory\n", argv[i]);
+            status = 127;
+        } else {
+            fflush(stdout);
+            launch_t l = { path, argv + i, -1, -1, -1, envp };
+            pid_t pid = launch(&l);
+            free(path);
+            struct rusage usage;
+            status = pid < 0 ? 126 : timeout_wait(pid, &usage);
+        }
+    }
+    free(envp);
+    return status;
+}
@@ -0,0 +1,404 @@
+#define _GNU_SOURCE
+
+#include "vars.h"
+#include "stats.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+extern char **environ;
+
+typedef struct var {
+    char *name;
+    char *value;
+    bool exported;
+    struct var *next;           // bucket chain
+} var;
+
+static struct {
+    var **buckets;
+    size_t nbuckets;
+    size_t count;
+    unsigned long generation;
+    int status;                 // $?
+
+    char **envp;                // "NAME=value" for each exported variable
+    bool envp_stale;            // an exported variable changed since it was built
+    char **override;            // see vars_override_environ()
+} vars;
+
+static unsigned long hash_name(const char *s, size_t len)
+{
+    unsigned long h = 14695981039346656037UL;   // FNV-1a
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211UL;
+    }
+    return h;
+}
+
+static var *lookup(const char *name, size_t len)
+{
+    if (vars.nbuckets == 0)
+        vars_init();
+    var *v = vars.buckets[hash_name(name, len) & (vars.nbuckets - 1)];
+    while (v != NULL && (strncmp(v->name, name, len) != 0 || v->name[len] != '\0'))
+        v = v->next;
+    return v;
+}
+
+static void grow_table(void)
+{
+    size_t old_n = vars.nbuckets;
+    var **old = vars.buckets;
+    vars.nbuckets = old_n ? old_n * 2 : 64;
+    vars.buckets = calloc(vars.nbuckets, sizeof(var *));
+    for (size_t b = 0; b < old_n; b++) {
+        for (var *v = old[b], *next; v != NULL; v = next) {
+            next = v->next;
+            size_t slot = hash_name(v->name, strlen(v->name)) & (vars.nbuckets - 1);
+            v->next = vars.buckets[slot];
+            vars.buckets[slot] = v;
+        }
+    }
+    free(old);
+}
+
+static var *insert(const char *name, size_t len)
+{
+    if (vars.count + 1 > vars.nbuckets)
+        grow_table();
+    var *v = calloc(1, sizeof(var));
+    v->name = strndup(name, len);
+    size_t slot = hash_name(name, len) & (vars.nbuckets - 1);
+    v->next = vars.buckets[slot];
+    vars.buckets[slot] = v;
+    vars.count++;
+    return v;
+}
+
+void vars_init(void)
+{
+    if (vars.nbuckets != 0)
+        return;
+    grow_table();
+    for (char **env = environ; *env != NULL; env++) {
+        const char *eq = strchr(*env, '=');
+        if (eq == NULL || lookup(*env, eq - *env) != NULL)
+            continue;
+        var *v = insert(*env, eq - *env);
+        v->value = strdup(eq + 1);
+        v->exported = true;
+    }
+    vars.envp_stale = true;
+}
+
+const char *vars_get(const char *name)
+{
+    var *v = lookup(name, strlen(name));
+    return v ? v->value : NULL;
+}
+
+void vars_set(const char *name, const char *value, bool export)
+{
+    size_t len = strlen(name);
+    var *v = lookup(name, len);
+    if (v == NULL)
+        v = insert(name, len);
+    if (value != NULL) {
+        free(v->value);
+        v->value = strdup(value);
+    }
+    v->exported |= export;
+    vars.generation++;
+    vars.envp_stale |= v->exported;
+}
+
+void vars_unset(const char *name)
+{
+    size_t len = strlen(name);
+    if (vars.nbuckets == 0)
+        vars_init();
+    var **link = &vars.buckets[hash_name(name, len) & (vars.nbuckets - 1)];
+    while (*link != NULL && strcmp((*link)->name, name) != 0)
+        link = &(*link)->next;
+    if (*link == NULL)
+        return;
+
+    var *v = *link;
+    *link = v->next;
+    vars.envp_stale |= v->exported;
+    free(v->name);
+    free(v->value);
+    free(v);
+    vars.count--;
+    vars.generation++;
+}
+
+static int compare_vars(const void *a, const void *b)
+{
+    return strcmp((*(var *const *)a)->name, (*(var *const *)b)->name);
+}
+
+void vars_print_exported(void)
+{
+    var **sorted = malloc((vars.count + 1) * sizeof(var *));
+    size_t n = 0;
+    for (size_t b = 0; b < vars.nbuckets; b++)
+        for (var *v = vars.buckets[b]; v != NULL; v = v->next)
+            if (v->exported)
+                sorted[n++] = v;
+    qsort(sorted, n, sizeof(var *), compare_vars);
+
+    for (size_t i = 0; i < n; i++) {
+        if (sorted[i]->value)
+            printf("export %s=\"%s\"\n", sorted[i]->name, sorted[i]->value);
+        else
+            printf("export %s\n", sorted[i]->name);
+    }
+    free(sorted);
+}
+
+// Pointers and strings in one block, so a rebuild is one free and one malloc
+static void build_environ(void)
+{
+    size_t n = 0;
+    size_t size = 0;
+    for (size_t b = 0; b < vars.nbuckets; b++) {
+        for (var *v = vars.buckets[b]; v != NULL; v = v->next) {
+            if (v->exported && v->value != NULL) {
+                n++;
+                size += strlen(v->name) + strlen(v->value) + 2;
+            }
+        }
+    }
+
+    char **envp = malloc((n + 1) * sizeof(char *) + size);
+    char *p = (char *)(envp + n + 1);
+    n = 0;
+    for (size_t b = 0; b < vars.nbuckets; b++) {
+        for (var *v = vars.buckets[b]; v != NULL; v = v->next) {
+            if (v->exported && v->value != NULL) {
+                envp[n++] = p;
+                p = stpcpy(p, v->name);
+                *p++ = '=';
+                p = stpcpy(p, v->value) + 1;
+            }
+        }
+    }
+    envp[n] = NULL;
+
+    // getenv() in the shell sees what its children get
+    environ = envp;
+    free(vars.envp);
+    vars.envp = envp;
+    vars.envp_stale = false;
+}
+
+char **vars_environ(void)
+{
+    if (vars.override != NULL)
+        return vars.override;
+    if (vars.nbuckets == 0)
+        vars_init();
+    if (vars.envp_stale)
+        build_environ();
+    return vars.envp;
+}
+
+char **vars_environ_with(char *const *assignments, size_t n, bool empty)
+{
+    char **base = empty ? NULL : vars_environ();
+    size_t nbase = 0;
+    while (base != NULL && base[nbase] != NULL)
+        nbase++;
+
+    // "NAME=" lengths, so an entry is matched by one strncmp
+    size_t prefix[n > 0 ? n : 1];
+    for (size_t j = 0; j < n; j++)
+        prefix[j] = strchrnul(assignments[j], '=') - assignments[j] + 1;
+
+    char **envp = malloc((nbase + n + 1) * sizeof(char *));
+    size_t count = 0;
+    for (size_t i = 0; i < nbase; i++) {
+        size_t j = 0;
+        while (j < n && strncmp(base[i], assignments[j], prefix[j]) != 0)
+            j++;
+        if (j == n)
+            envp[count++] = base[i];
+    }
+    // the last of repeated assignments wins
+    for (size_t i = 0; i < n; i++) {
+        size_t j = i + 1;
+        while (j < n && (prefix[j] != prefix[i] ||
+                         strncmp(assignments[i], assignments[j], prefix[i]) != 0))
+            j++;
+        if (j == n)
+            envp[count++] = assignments[i];
+    }
+    envp[count] = NULL;
+    return envp;
+}
+
+char **vars_override_environ(char **envp)
+{
+    char **previous = vars.override;
+    vars.override = envp;
+    return previous;
+}
+
+unsigned long vars_generation(void)
+{
+    return vars.generation;
+}
+
+void vars_set_status(int status)
+{
+    vars.status = status;
+}
+
+static size_t name_length(const char *s)
+{
+    if (!isalpha((unsigned char)*s) && *s != '_')
+        return 0;
+    size_t n = 1;
+    while (isalnum((unsigned char)s[n]) || s[n] == '_')
+        n++;
+    return n;
+}
+
+bool is_valid_name(const char *s)
+{
+    size_t n = name_length(s);
+    return n > 0 && s[n] == '\0';
+}
+
+bool is_assignment(const char *word)
+{
+    size_t n = name_length(word);
+    return n > 0 && word[n] == '=';
+}
+
+// Scratch space for one expanded word, reused for every word
+static struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+} out;
+
+static void emit(const char *s, size_t n)
+{
+    if (out.len + n + 1 > out.cap) {
+        out.cap = (out.len + n + 1) * 2;
+        out.buf = realloc(out.buf, out.cap);
+    }
+    memcpy(out.buf + out.len, s, n);
+    out.len += n;
+}
+
+static void emit_str(const char *s)
+{
+    if (s != NULL)
+        emit(s, strlen(s));
+}
+
+static void expand_word(const char *p)
+{
+    out.len = 0;
+    emit("", 0);
+
+    if (p[0] == '~' && (p[1] == '\0' || p[1] == '/')) {
+        const char *home = vars_get("HOME");
+        if (home != NULL && home[0] != '\0') {
+            emit_str(home);
+            p++;
+        }
+    }
+
+    while (*p) {
+        size_t run = strcspn(p, "$" "\001");
+        emit(p, run);
+        p += run;
+
+        if (*p == CTLESC) {
+            // quoted: the next character is literal
+            if (p[1] != '\0')
+                emit(p + 1, 1);
+            p += p[1] != '\0' ? 2 : 1;
+            continue;
+        }
+        if (*p != '$')
+            break;
+
+        char num[24];
+        size_t n;
+        if (p[1] == '?') {
+            emit(num, snprintf(num, sizeof(num), "%d", vars.status));
+            p += 2;
+        } else if (p[1] == '$') {
+            emit(num, snprintf(num, sizeof(num), "%d", (int)getpid()));
+            p += 2;
+        } else if (p[1] == '{' && (n = name_length(p + 2)) > 0 && p[2 + n] == '}') {
+            var *v = lookup(p + 2, n);
+            emit_str(v ? v->value : NULL);
+            p += n + 3;
+        } else if ((n = name_length(p + 1)) > 0) {
+            var *v = lookup(p + 1, n);
+            emit_str(v ? v->value : NULL);
+            p += n + 1;
+        } else {
+            emit("$", 1);   // not a parameter: a literal $
+            p++;
+        }
+    }
+    out.buf[out.len] = '\0';
+}
+
+// Remembers that the item (after expansion) is a real assignment
+static void add_assignment(tokenlist *tokens, char *word)
+{
+    size_t n = tokens->nassignments;
+    if ((n & (n - 1)) == 0)     // 0, 1, 2, 4...: full
+        tokens->assignments = realloc(tokens->assignments, (n ? 2 * n : 1) * sizeof(char *));
+    tokens->assignments[tokens->nassignments++] = word;
+}
+
+void expand_tokens(tokenlist *tokens)
+{
+    STATS_BEGIN(t);
+    bool command_start = true;  // only assignments before a command's name count
+    bool redirect_target = false;
+    for (size_t i = 0; i < tokens->size; i++) {
+        char *tok = tokens->items[i];
+        if (is_any_operator(tok)) {
+            redirect_target = is_operator(tok, "<") || is_operator(tok, ">");
+            command_start |= !redirect_target;
+            continue;
+        }
+        // decided on the word as written: the lexer marks a quoted NAME=
+        bool assignment = command_start && !redirect_target && is_assignment(tok);
+        command_start &= assignment || redirect_target;
+        redirect_target = false;
+        if (strpbrk(tok, "$~" "\001") != NULL) {
+            expand_word(tok);
+            // the word's own bytes are reused when the result fits
+            if (out.len > strlen(tok))
+                tokens->items[i] = tokens_alloc(tokens, out.len + 1);
+            memcpy(tokens->items[i], out.buf, out.len + 1);
+        }
+        if (assignment)
+            add_assignment(tokens, tokens->items[i]);
+    }
+    STATS_END(STAT_EXPAND, t);
+}
+
+bool is_assignment_word(const tokenlist *tokens, const char *word)
+{
+    for (size_t i = 0; i < tokens->nassignments; i++)
+        if (tokens->assignments[i] == word)
+            return true;
+    return false;
+}
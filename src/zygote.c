@@ -0,0 +1,329 @@
+#define _GNU_SOURCE
+
+#include "zygote.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#define ZYGOTE_FD 3     // the helper's end of the socketpair
+#define REQUEST_FDS 4   // stdin, stdout, stderr and the cwd
+
+// One request: this header, carrying the child's stdin, stdout, stderr and
+// working directory as SCM_RIGHTS, then `size` bytes of NUL-terminated strings: the path,
+// argc argv words and envc environment entries
+typedef struct {
+    uint32_t size;
+    uint32_t argc;
+    uint32_t envc;
+} zygote_request;
+
+// The answer, carrying the child's pidfd when pid > 0
+typedef struct {
+    int32_t pid;
+    int32_t error;      // errno of a failed clone3
+} zygote_reply;
+
+static int sock = -1;   // the shell's end
+static pid_t owner;     // the process the helper launches for
+
+// Signals from the terminal are for the commands, not the helper; the
+// children get back the dispositions the helper started with
+static const int terminal_signals[] = { SIGINT, SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU };
+#define NTERMINAL_SIGNALS (sizeof(terminal_signals) / sizeof(terminal_signals[0]))
+static struct sigaction inherited[NTERMINAL_SIGNALS];
+
+static bool send_all(int fd, const char *p, size_t n)
+{
+    while (n > 0) {
+        ssize_t w = send(fd, p, n, MSG_NOSIGNAL);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return false;
+        p += w;
+        n -= w;
+    }
+    return true;
+}
+
+static bool recv_all(int fd, char *p, size_t n)
+{
+    while (n > 0) {
+        ssize_t r = recv(fd, p, n, 0);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return false;
+        p += r;
+        n -= r;
+    }
+    return true;
+}
+
+// Sends len bytes (a small header) with nfds descriptors attached
+static bool send_fds(int fd, const void *data, size_t len, const int *fds, int nfds)
+{
+    union {
+        char buf[CMSG_SPACE(REQUEST_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { (void *)data, len };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+    if (nfds > 0) {
+        msg.msg_control = control.buf;
+        msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+        struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+        memcpy(CMSG_DATA(c), fds, nfds * sizeof(int));
+    }
+
+    ssize_t n;
+    do
+        n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    while (n < 0 && errno == EINTR);
+    return n == (ssize_t)len;
+}
+
+/**
+ * Receives a len-byte header and up to *nfds descriptors sent with it
+ * (close-on-exec); *nfds becomes the number received.
+ */
+static bool recv_fds(int fd, void *data, size_t len, int *fds, int *nfds)
+{
+    union {
+        char buf[CMSG_SPACE(REQUEST_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { data, len };
+    struct msghdr msg = {
+        .msg_iov = &iov, .msg_iovlen = 1,
+        .msg_control = control.buf, .msg_controllen = CMSG_SPACE(*nfds * sizeof(int)),
+    };
+
+    ssize_t n;
+    do
+        n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    while (n < 0 && errno == EINTR);
+    if (n <= 0)
+        return false;
+
+    int got = 0;
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    if (c != NULL && c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+        got = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        memcpy(fds, CMSG_DATA(c), got * sizeof(int));
+    }
+    *nfds = got;
+    return recv_all(fd, (char *)data + n, len - n);
+}
+
+// In the new child: the state any launcher gives a command, then exec
+static void __attribute__((noreturn)) exec_child(const int *fds, char *path, char **argv, char **envp)
+{
+    sigset_t empty;
+    sigemptyset(&empty);
+    sigprocmask(SIG_SETMASK, &empty, NULL);
+    for (size_t i = 0; i < NTERMINAL_SIGNALS; i++)
+        sigaction(terminal_signals[i], &inherited[i], NULL);
+
+    // the helper stays where the shell was when it started; the command
+    // runs where the shell is now
+    if (fchdir(fds[3]) < 0) {
+        fprintf(stderr, "%s: cannot enter working directory: %s\n", path, strerror(errno));
+        _exit(127);
+    }
+    for (int i = 0; i < 3; i++)
+        dup2(fds[i], i);
+    execve(path, argv, envp);
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    _exit(127);
+}
+
+// Serves one request; false once the shell has gone away
+static bool serve(int fd)
+{
+    zygote_request req;
+    int fds[REQUEST_FDS];
+    int nfds = REQUEST_FDS;
+    if (!recv_fds(fd, &req, sizeof(req), fds, &nfds))
+        return false;
+
+    char *strings = malloc(req.size);
+    char **argv = malloc((req.argc + 1) * sizeof(char *));
+    char **envp = malloc((req.envc + 1) * sizeof(char *));
+    bool ok = strings && argv && envp && nfds == REQUEST_FDS && recv_all(fd, strings, req.size);
+
+    zygote_reply reply = { -1, EINVAL };
+    int pidfd = -1;
+    if (ok && req.size > 0 && strings[req.size - 1] == '\0') {
+        char *p = strings + strlen(strings) + 1;
+        for (uint32_t i = 0; i < req.argc; i++, p += strlen(p) + 1)
+            argv[i] = p;
+        argv[req.argc] = NULL;
+        for (uint32_t i = 0; i < req.envc; i++, p += strlen(p) + 1)
+            envp[i] = p;
+        envp[req.envc] = NULL;
+
+        // CLONE_PARENT: the child's parent is the shell, which reaps it.
+        // Its exit signal is the helper's own (SIGCHLD); clone3 requires
+        // exit_signal to be 0 with this flag.
+        struct clone_args args = {
+            .flags = CLONE_PARENT | CLONE_PIDFD,
+            .pidfd = (uintptr_t)&pidfd,
+        };
+        pid_t pid = syscall(SYS_clone3, &args, sizeof(args));
+        if (pid == 0)
+            exec_child(fds, strings, argv, envp);
+        reply.pid = pid;
+        reply.error = pid < 0 ? errno : 0;
+    }
+
+    for (int i = 0; i < nfds; i++)
+        close(fds[i]);
+    free(strings);
+    free(argv);
+    free(envp);
+    if (!ok)
+        return false;
+
+    ok = send_fds(fd, &reply, sizeof(reply), &pidfd, pidfd >= 0 ? 1 : 0);
+    if (pidfd >= 0)
+        close(pidfd);
+    return ok;
+}
+
+static void __attribute__((noreturn)) helper_main(int fd)
+{
+    struct sigaction ignore = { .sa_handler = SIG_IGN };
+    for (size_t i = 0; i < NTERMINAL_SIGNALS; i++)
+        sigaction(terminal_signals[i], &ignore, &inherited[i]);
+    while (serve(fd))
+        ;
+    _exit(0);
+}
+
+bool zygote_running(void)
+{
+    // a forked subshell cannot share the helper: its children would
+    // become the parent shell's
+    return sock >= 0 && getpid() == owner;
+}
+
+bool zygote_start(void)
+{
+    if (zygote_running())
+        return true;
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) {
+        perror("zygote: socketpair");
+        return false;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("zygote: fork");
+        close(sv[0]);
+        close(sv[1]);
+        return false;
+    }
+
+    if (pid == 0) {
+        // keep only stdio (the default for commands) and the socket
+        if (sv[1] != ZYGOTE_FD) {
+            dup2(sv[1], ZYGOTE_FD);
+            fcntl(ZYGOTE_FD, F_SETFD, FD_CLOEXEC);
+        }
+        close_range(ZYGOTE_FD + 1, ~0U, 0);
+        helper_main(ZYGOTE_FD);
+    }
+
+    close(sv[1]);
+    if (sock >= 0)
+        close(sock);    // inherited from the shell this one was forked from
+    sock = sv[0];
+    owner = getpid();
+    return true;
+}
+
+static void stop(const char *why)
+{
+    fprintf(stderr, "launcher: zygote %s, using spawn\n", why);
+    close(sock);        // the helper exits at end of input
+    sock = -1;
+}
+
+pid_t zygote_launch(const launch_t *l, int *pidfd)
+{
+    *pidfd = -1;
+    if (!zygote_running())
+        return -1;
+
+    // -1 means the shell's own stdio, as it is right now
+    int fds[REQUEST_FDS] = {
+        l->in_fd >= 0 ? l->in_fd : STDIN_FILENO,
+        l->out_fd >= 0 ? l->out_fd : STDOUT_FILENO,
+        l->err_fd >= 0 ? l->err_fd : STDERR_FILENO,
+        -1,
+    };
+    for (int i = 0; i < 3; i++)
+        if (fcntl(fds[i], F_GETFD) < 0)
+            return -1;  // a closed descriptor cannot be sent
+    fds[3] = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (fds[3] < 0)
+        return -1;
+
+    uint32_t argc = 0;
+    uint32_t envc = 0;
+    size_t size = strlen(l->path) + 1;
+    for (; l->argv[argc] != NULL; argc++)
+        size += strlen(l->argv[argc]) + 1;
+    for (; l->envp[envc] != NULL; envc++)
+        size += strlen(l->envp[envc]) + 1;
+
+    char *strings = malloc(size);
+    char *p = stpcpy(strings, l->path) + 1;
+    for (uint32_t i = 0; i < argc; i++)
+        p = stpcpy(p, l->argv[i]) + 1;
+    for (uint32_t i = 0; i < envc; i++)
+        p = stpcpy(p, l->envp[i]) + 1;
+
+    zygote_request req = { size, argc, envc };
+    zygote_reply reply;
+    int nfds = 1;
+    bool ok = send_fds(sock, &req, sizeof(req), fds, REQUEST_FDS) &&
+              send_all(sock, strings, size) &&
+              recv_fds(sock, &reply, sizeof(reply), pidfd, &nfds);
+    close(fds[3]);
+    free(strings);
+    if (!ok) {
+        *pidfd = -1;
+        stop("helper is gone");
+        return -1;
+    }
+    if (nfds == 0)
+        *pidfd = -1;
+
+    if (reply.pid < 0) {
+        // clone3 or CLONE_PARENT unavailable here: not worth retrying
+        if (reply.error == ENOSYS || reply.error == EINVAL || reply.error == EPERM) {
+            errno = reply.error;
+            char why[128];
+            snprintf(why, sizeof(why), "cannot clone3: %s", strerror(errno));
+            stop(why);
+        }
+        return -1;
+    }
+    return reply.pid;
+}